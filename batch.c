@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FAST_CHECKS 6        // lock delay checks a fast frame can make: 2 rotations, 3 moves, gravity
+#define SLOW_INPUTS (IN_HOLD | IN_HARD_DROP | IN_QUIT)
+#define FAST_INPUTS (IN_MV_LEFT | IN_MV_RIGHT | IN_ROTATE_CW | IN_ROTATE_CCW | IN_SOFT_DROP) // the low bits
+#define PASS(in) __builtin_ctz(in)   // list of the games with an input
+#define BYTES_LOW 0x0101010101010101ull
+#define Y_MIN (-BATCH_TOP)                         // candidate rows, the rest never fit
+#define Y_MAX (BATCH_ROWS - BATCH_TOP - TM_SIZE - 1) // leaves a row under them for the landing test
+#define X_MIN (-(TM_SIZE - 1))
+#define X_MAX (FIELD_X - 1)
+
+// Tests whether a candidate position fits on the board copy of its game
+// and whether it fits a row lower, so that a move lands in the same test;
+// the walls stand for the bounds of the field
+static inline void fits_one(Batch *batch, u32 k) {
+    i16 y = batch->cy[k], x = batch->cx[k];
+    const u16 *row;
+    u64 mask, rows;
+
+    batch->ok[k] = batch->low[k] = false;
+    if (y < Y_MIN || y > Y_MAX || x < X_MIN || x > X_MAX)
+        return;
+
+    row = &batch->board[batch->pick[k]][y + BATCH_TOP];
+    mask = batch->mask[batch->ctype[k]][batch->co[k]][TM_COL(x)];
+    memcpy(&rows, row, sizeof(rows));
+    batch->ok[k] = (rows & mask) == 0;
+    memcpy(&rows, row + 1, sizeof(rows));
+    batch->low[k] = (rows & mask) == 0;
+}
+
+static void fits_all(Batch *batch, u32 num) {
+    for (u32 k = 0; k < num; k++)
+        fits_one(batch, k);
+}
+
+// Ticks the timers of the games in the fast passes; the ones whose gravity
+// acts fall a row, which fits as they weren't on the floor.
+// Branchless on masks of all ones, and the arrays are restrict parameters:
+// stores through u8 pointers could change the batch otherwise, which keeps
+// the loop from being vectorized.
+static inline __attribute__((always_inline))
+void countdown_lanes(u32 cap, const u8 *restrict active, const u8 *restrict on_floor, const u8 *restrict gravity,
+                     u8 *restrict gravity_timer, u8 *restrict floor_timer, u8 *restrict gravity_acted,
+                     u8 *restrict fell, i16 *restrict y) {
+    for (u32 i = 0; i < cap; i++) {
+        u8 on = -active[i], floor = -(active[i] & on_floor[i]);
+        u8 timer = (gravity[i] & floor) | (gravity_timer[i] & ~floor);
+        u8 due = on & -(timer == 0);
+
+        floor_timer[i] += floor; // -1 on the floor
+        timer = (gravity[i] & due) | (timer & ~due);
+        gravity_acted[i] = (due & 1) | (gravity_acted[i] & ~on);
+        gravity_timer[i] = ((timer - 1) & on) | (gravity_timer[i] & ~on);
+        y[i] += due & 1;
+        fell[i] = due & 1;
+    }
+}
+
+static void countdown(Batch *batch) {
+    countdown_lanes(batch->cap, batch->active, batch->on_floor, batch->gravity, batch->gravity_timer,
+                    batch->floor_timer, batch->gravity_acted, batch->fell, batch->y);
+}
+
+// Fills the rows a tetromino position takes on a board copy, BLACK takes all
+// of them so that it never fits, and the set bits of every 8-bit mask
+static void init_tables(Batch *batch) {
+    const Vec *block;
+    u16 rows[TM_SIZE];
+
+    for (u8 t = 0; t <= TM_NUM; t++) {
+        for (u8 o = 0; o < TM_ORIENT; o++) {
+            for (u8 c = 0; c < TM_COLS; c++) {
+                memset(rows, t == TM_NUM ? 0xff : 0, sizeof(rows));
+                block = TM_SHAPE[t < TM_NUM ? t : 0][o].block;
+                for (u8 i = 0; i < TM_SIZE && t < TM_NUM; i++)
+                    rows[block[i].y] |= 1 << (c + block[i].x);
+                memcpy(&batch->mask[t][o][c], rows, sizeof(rows));
+            }
+        }
+    }
+
+    for (u16 m = 0; m < 256; m++) {
+        u8 n = 0;
+        for (u8 j = 0; j < BATCH_LANES; j++)
+            if (m & (1 << j))
+                batch->pack[m][n++] = j;
+        batch->pack_num[m] = n;
+    }
+}
+
+// Sets up num games seeded with seed, seed + 1 and so on;
+// false when out of memory
+bool batch_init(Batch *batch, u32 num, u64 seed) {
+    u32 cap = (num + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    bool lists = true;
+
+    memset(batch, 0, sizeof(Batch));
+    batch->num = num;
+    batch->cap = cap;
+
+    batch->game = calloc(cap, sizeof(Game));
+    if (posix_memalign((void **) &batch->board, 64, cap * sizeof(batch->board[0])) != 0)
+        batch->board = NULL;
+    batch->type = calloc(cap, 1);
+    batch->orientation = calloc(cap, 1);
+    batch->y = calloc(cap, sizeof(i16));
+    batch->x = calloc(cap, sizeof(i16));
+    batch->gravity_timer = calloc(cap, 1);
+    batch->floor_timer = calloc(cap, 1);
+    batch->floor_counter = calloc(cap, 1);
+    batch->entry_delay = calloc(cap, 1);
+    batch->on_floor = calloc(cap, 1);
+    batch->gravity_acted = calloc(cap, 1);
+    batch->gravity = calloc(cap, 1);
+    batch->score = calloc(cap, sizeof(u32));
+    batch->done = calloc(cap, 1);
+    batch->slow = calloc(cap, 1);
+    batch->active = calloc(cap, 1);
+    batch->fell = calloc(cap, 1);
+    batch->pass = calloc(cap, 1);
+    for (u8 p = 0; p < BATCH_PASSES; p++) {
+        batch->list[p] = calloc(cap + BATCH_LANES, sizeof(u32)); // room for the stores of pack_games()
+        lists = lists && batch->list[p] != NULL;
+    }
+    batch->queue = calloc(cap + BATCH_LANES, sizeof(u32));
+    batch->pick = calloc(cap + BATCH_LANES, sizeof(u32));
+    batch->ctype = calloc(cap, 1);
+    batch->co = calloc(cap, 1);
+    batch->cy = calloc(cap, sizeof(i16));
+    batch->cx = calloc(cap, sizeof(i16));
+    batch->ok = calloc(cap, 1);
+    batch->low = calloc(cap, 1);
+    if (!lists || batch->game == NULL || batch->board == NULL || batch->type == NULL ||
+        batch->orientation == NULL || batch->y == NULL || batch->x == NULL || batch->gravity_timer == NULL ||
+        batch->floor_timer == NULL || batch->floor_counter == NULL || batch->entry_delay == NULL ||
+        batch->on_floor == NULL || batch->gravity_acted == NULL || batch->gravity == NULL ||
+        batch->score == NULL || batch->done == NULL || batch->slow == NULL || batch->active == NULL ||
+        batch->fell == NULL || batch->pass == NULL || batch->queue == NULL || batch->pick == NULL ||
+        batch->ctype == NULL || batch->co == NULL || batch->cy == NULL || batch->cx == NULL ||
+        batch->ok == NULL || batch->low == NULL) {
+        batch_free(batch);
+        return false;
+    }
+
+    init_tables(batch);
+    memset(batch->board, 0xff, cap * sizeof(batch->board[0]));
+    for (u32 i = 0; i < cap; i++) {
+        batch->type[i] = BLACK;
+        if (i < num)
+            batch_reset(batch, i, seed + i);
+        else
+            batch->done[i] = true; // padding
+    }
+    return true;
+}
+
+void batch_free(Batch *batch) {
+    free(batch->game);
+    free(batch->board);
+    free(batch->type);
+    free(batch->orientation);
+    free(batch->y);
+    free(batch->x);
+    free(batch->gravity_timer);
+    free(batch->floor_timer);
+    free(batch->floor_counter);
+    free(batch->entry_delay);
+    free(batch->on_floor);
+    free(batch->gravity_acted);
+    free(batch->gravity);
+    free(batch->score);
+    free(batch->done);
+    free(batch->slow);
+    free(batch->active);
+    free(batch->fell);
+    free(batch->pass);
+    for (u8 p = 0; p < BATCH_PASSES; p++)
+        free(batch->list[p]);
+    free(batch->queue);
+    free(batch->pick);
+    free(batch->ctype);
+    free(batch->co);
+    free(batch->cy);
+    free(batch->cx);
+    free(batch->ok);
+    free(batch->low);
+    memset(batch, 0, sizeof(Batch));
+}
+
+// Takes the fast fields of a game from its full state
+static void store(Batch *batch, u32 i) {
+    const Game *game = &batch->game[i];
+
+    batch->type[i] = game->tm_field.type;
+    batch->orientation[i] = game->tm_field.orientation;
+    batch->y[i] = game->tm_field.pos.y;
+    batch->x[i] = game->tm_field.pos.x;
+    batch->gravity_timer[i] = game->gravity_timer;
+    batch->floor_timer[i] = game->floor_timer;
+    batch->floor_counter[i] = game->floor_counter;
+    batch->entry_delay[i] = game->entry_delay;
+    batch->on_floor[i] = game->on_floor;
+    batch->gravity_acted[i] = game->gravity_acted;
+    batch->score[i] = game->score;
+}
+
+// Takes the board copy and the gravity of a game, they change with locks only
+static void store_board(Batch *batch, u32 i) {
+    const Game *game = &batch->game[i];
+
+    batch->gravity[i] = gravity(game->level);
+    for (u8 y = 0; y < FIELD_Y; y++)
+        batch->board[i][y + BATCH_TOP] = game->board[y] << (TM_SIZE - 1) | BATCH_WALLS;
+}
+
+// Starts a new game in a lane
+void batch_reset(Batch *batch, u32 lane, u64 seed) {
+    game_init(&batch->game[lane], seed);
+    store(batch, lane);
+    store_board(batch, lane);
+    batch->done[lane] = false;
+    batch->slow[lane] = true;
+}
+
+// Replaces the game of a lane
+void batch_set(Batch *batch, u32 lane, const Game *game) {
+    batch->game[lane] = *game;
+    store(batch, lane);
+    store_board(batch, lane);
+    batch->done[lane] = game->over;
+    batch->slow[lane] = true;
+}
+
+// Copies out the game of a lane as tick() would have left it
+void batch_get(const Batch *batch, u32 lane, Game *game) {
+    *game = batch->game[lane];
+    game->tm_field = (Tetromino) { batch->type[lane], batch->orientation[lane], { batch->y[lane], batch->x[lane] } };
+    game->gravity_timer = batch->gravity_timer[lane];
+    game->floor_timer = batch->floor_timer[lane];
+    game->floor_counter = batch->floor_counter[lane];
+    game->entry_delay = batch->entry_delay[lane];
+    game->on_floor = batch->on_floor[lane];
+    game->gravity_acted = batch->gravity_acted[lane];
+    game->score = batch->score[lane];
+    if (!batch->slow[lane]) {
+        game->tm_locked.type = BLACK;
+        game->cleared = 0;
+    }
+}
+
+// Runs a frame of a game on its full state
+static void step_slow(Batch *batch, u32 i, u16 input) {
+    batch_get(batch, i, &batch->game[i]);
+    batch->done[i] = !tick(&batch->game[i], input);
+    store(batch, i);
+    if (batch->game[i].tm_locked.type != BLACK)
+        store_board(batch, i);
+}
+
+// Queues the position a game tries
+static inline void candidate(Batch *batch, u32 k, u32 i, u8 orientation, i16 y, i16 x) {
+    batch->pick[k] = i;
+    batch->ctype[k] = batch->type[i];
+    batch->co[k] = orientation;
+    batch->cy[k] = y;
+    batch->cx[k] = x;
+}
+
+// Sets the floor flag of a game from a landing test, like tmf_mv() the ones
+// landed use up a lock delay move
+static inline void land(Batch *batch, u32 i, bool low) {
+    batch->on_floor[i] = !low;
+    if (!low) {
+        batch->floor_counter[i]--;
+        batch->floor_timer[i] = LOCKDOWN_FRAMES;
+    }
+}
+
+// Moves the field tetromino of the listed games by an offset like tmf_mv(),
+// leaves the games it moved in the list and returns their number
+static u32 shift(Batch *batch, u32 *list, u32 num, i16 dy, i16 dx) {
+    u32 i, moved = 0;
+
+    if (num == 0)
+        return 0;
+    for (u32 k = 0; k < num; k++) {
+        i = list[k];
+        candidate(batch, k, i, batch->orientation[i], batch->y[i] + dy, batch->x[i] + dx);
+    }
+    fits_all(batch, num);
+
+    for (u32 k = 0; k < num; k++) {
+        if (batch->ok[k]) {
+            i = batch->pick[k];
+            batch->y[i] = batch->cy[k];
+            batch->x[i] = batch->cx[k];
+            land(batch, i, batch->low[k]);
+            list[moved++] = i;
+        }
+    }
+    return moved;
+}
+
+// Rotates the field tetromino of the listed games like tm_rotate(), the
+// games still kicking are tested together for each wall kick
+static void rotate(Batch *batch, const u32 *list, u32 num, bool clockwise) {
+    const Vec (*kicks)[TM_ROT_DIRS][TM_ORIENT][WK_TESTS];
+    const Vec *kick;
+    u32 i, left = 0;
+
+    for (u32 k = 0; k < num; k++) {
+        i = list[k];
+        if (batch->on_floor[i]) {
+            batch->floor_counter[i]--;
+            batch->floor_timer[i] = LOCKDOWN_FRAMES;
+        }
+        if (batch->type[i] == TM_O)
+            batch->orientation[i] = (batch->orientation[i] + 1) % TM_ORIENT;
+        else
+            candidate(batch, left++, i, (batch->orientation[i] + (clockwise ? 1 : TM_ORIENT - 1)) % TM_ORIENT,
+                      batch->y[i], batch->x[i]);
+    }
+
+    for (u8 test = 0; left > 0; test++) {
+        fits_all(batch, left);
+        num = left;
+        left = 0;
+        for (u32 k = 0; k < num; k++) {
+            i = batch->pick[k];
+            if (batch->ok[k]) {
+                batch->orientation[i] = batch->co[k];
+                batch->y[i] = batch->cy[k];
+                batch->x[i] = batch->cx[k];
+                batch->on_floor[i] = !batch->low[k];
+            } else if (test < WK_TESTS) {
+                kicks = batch->type[i] != TM_I ? &WALL_KICK : &WALL_KICK_I;
+                kick = &(*kicks)[clockwise ? 0 : 1][batch->co[k]][test];
+                candidate(batch, left++, i, batch->co[k], batch->y[i] + kick->y, batch->x[i] + kick->x);
+            }
+        }
+    }
+}
+
+// Sorts the games out for a step: entry delays count down, frames that
+// could lock, spawn or hold run slow, the rest take the fast passes of their
+// inputs. Branchless on masks of all ones and restrict arrays, so that it is
+// vectorized.
+static inline __attribute__((always_inline))
+void sort_lanes(u32 cap, const u16 *restrict input, const u8 *restrict done, const u8 *restrict on_floor,
+                u8 *restrict entry_delay, u8 *restrict floor_counter, u8 *restrict floor_timer,
+                u8 *restrict active, u8 *restrict slow, u8 *restrict pass) {
+    for (u32 i = 0; i < cap; i++) {
+        u8 live = -(done[i] == 0);
+        u8 wait = live & -(entry_delay[i] > 1);
+        u8 stop = live & ~wait & (-(entry_delay[i] == 1) | -((input[i] & SLOW_INPUTS) != 0) |
+                                  (-(on_floor[i] != 0) & (-(floor_counter[i] < FAST_CHECKS) | -(floor_timer[i] <= 1))));
+        u8 go = live & ~wait & ~stop;
+        u8 air = go & -(on_floor[i] == 0);
+
+        entry_delay[i] -= wait & 1;
+        floor_counter[i] = (FLOOR_MOVES & air) | (floor_counter[i] & ~air);
+        floor_timer[i] = (LOCKDOWN_FRAMES & air) | (floor_timer[i] & ~air);
+        active[i] = go & 1;
+        slow[i] = stop & 1;
+        pass[i] = input[i] & FAST_INPUTS & go;
+    }
+}
+
+// Appends the games of 8 whose flag has a bit to a list; the lane bytes
+// are gathered into a mask by a multiplication, and the games of the mask
+// are written by vector stores, up to 8 past the end
+static inline u32 pack_games(const Batch *batch, u32 *list, u32 num, u32 i, u64 flags) {
+    u8 mask = ((flags & BYTES_LOW) * 0x0102040810204080ull) >> 56;
+#ifdef __SSE2__
+    __m128i lane = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) batch->pack[mask]), _mm_setzero_si128());
+    __m128i base = _mm_set1_epi32(i);
+
+    _mm_storeu_si128((__m128i *) &list[num], _mm_add_epi32(_mm_unpacklo_epi16(lane, _mm_setzero_si128()), base));
+    _mm_storeu_si128((__m128i *) &list[num + 4], _mm_add_epi32(_mm_unpackhi_epi16(lane, _mm_setzero_si128()), base));
+#else
+    for (u8 j = 0; j < 8; j++)
+        list[num + j] = i + batch->pack[mask][j];
+#endif
+    return num + batch->pack_num[mask];
+}
+
+// Lists the games of every pass and queues the slow ones, returns the number
+// queued; the lists are taken out of the batch, stores to them could change it
+static u32 list_games(const Batch *batch, u32 count[BATCH_PASSES]) {
+    u32 *list[BATCH_PASSES], *queue = batch->queue, cap = batch->cap, queued = 0;
+    u32 listed[BATCH_PASSES] = { 0 };
+    u64 pass, slow;
+
+    for (u8 p = 0; p < BATCH_PASSES; p++)
+        list[p] = batch->list[p];
+    for (u32 i = 0; i < cap; i += 8) {
+        memcpy(&pass, &batch->pass[i], 8);
+        memcpy(&slow, &batch->slow[i], 8);
+        queued = pack_games(batch, queue, queued, i, slow);
+        for (u8 p = 0; p < BATCH_PASSES; p++)
+            listed[p] = pack_games(batch, list[p], listed[p], i, pass >> p);
+    }
+
+    memcpy(count, listed, sizeof(listed));
+    return queued;
+}
+
+// Steps every running game by a frame with an input each,
+// returns the number of games still running
+u32 batch_step(Batch *batch, const u16 *input) {
+    u32 count[BATCH_PASSES], running = 0, num;
+    u64 fell;
+
+    sort_lanes(batch->cap, input, batch->done, batch->on_floor, batch->entry_delay, batch->floor_counter,
+               batch->floor_timer, batch->active, batch->slow, batch->pass);
+    num = list_games(batch, count);
+    for (u32 k = 0; k < num; k++)
+        step_slow(batch, batch->queue[k], input[batch->queue[k]]);
+
+    rotate(batch, batch->list[PASS(IN_ROTATE_CW)], count[PASS(IN_ROTATE_CW)], true);
+    rotate(batch, batch->list[PASS(IN_ROTATE_CCW)], count[PASS(IN_ROTATE_CCW)], false);
+    shift(batch, batch->list[PASS(IN_MV_LEFT)], count[PASS(IN_MV_LEFT)], 0, -1);
+    shift(batch, batch->list[PASS(IN_MV_RIGHT)], count[PASS(IN_MV_RIGHT)], 0, 1);
+    num = shift(batch, batch->list[PASS(IN_SOFT_DROP)], count[PASS(IN_SOFT_DROP)], 1, 0);
+    for (u32 k = 0; k < num; k++) {
+        u32 i = batch->list[PASS(IN_SOFT_DROP)][k];
+        batch->score[i]++;
+        batch->gravity_acted[i] = true;
+        batch->gravity_timer[i] = batch->gravity[i];
+    }
+
+    // gravity, then the games it moved may land
+    countdown(batch);
+    num = 0;
+    for (u32 i = 0; i < batch->cap; i += 8) {
+        memcpy(&fell, &batch->fell[i], 8);
+        num = pack_games(batch, batch->pick, num, i, fell);
+    }
+    for (u32 k = 0; k < num; k++) {
+        u32 i = batch->pick[k];
+        candidate(batch, k, i, batch->orientation[i], batch->y[i], batch->x[i]);
+    }
+    if (num > 0)
+        fits_all(batch, num);
+    for (u32 k = 0; k < num; k++)
+        land(batch, batch->pick[k], batch->low[k]);
+
+    for (u32 i = 0; i < batch->num; i++)
+        running += !batch->done[i];
+    return running;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "game.h"
+#include "tm_table.h"
+
+// Lockstep stepping of many games, one input for every game per call.
+// What a frame reads and writes in the common case is kept in arrays with
+// an element per game: the field tetromino, the timers, the floor flags,
+// the score and a copy of the board inside walls, 64 bytes per game.
+// A step runs every game through the frame in passes: each input gathers
+// the games that have it into a list, and the positions the games of a pass
+// try are tested together, along with the ones a row lower for landing;
+// the timers count down in a branchless loop over every game, which the
+// compiler vectorizes.
+// Games whose frame could lock, spawn or hold a tetromino (entry delay
+// ending, hold and hard drop inputs, lock delay running out) run tick() on
+// their full Game instead, which also clears the lines, so a batch plays
+// exactly like separate tick() calls.
+
+#define BATCH_LANES 8        // games are padded to a multiple of this
+#define BATCH_ROWS 32        // rows of a board copy: walls, the field, walls
+#define BATCH_TOP 4          // wall rows above the field
+#define BATCH_WALLS 0xe007   // wall bits of a board copy row, the field is shifted by 3
+#define BATCH_PASSES 5       // inputs taken by the fast passes: 2 rotations, 3 moves
+
+typedef struct Batch {
+    u32 num;                 // games
+    u32 cap;                 // games rounded up to BATCH_LANES, the rest never run
+    Game *game;              // full states, the fields below are newer between slow frames
+    u16 (*board)[BATCH_ROWS];
+    u8 *type;                // field tetromino
+    u8 *orientation;
+    i16 *y;
+    i16 *x;
+    u8 *gravity_timer;
+    u8 *floor_timer;
+    u8 *floor_counter;
+    u8 *entry_delay;
+    u8 *on_floor;
+    u8 *gravity_acted;
+    u8 *gravity;             // frames per row at the level of the game
+    u32 *score;
+    u8 *done;                // ended or quit, not stepped until reset
+    u8 *slow;                // the last step ran tick() on the full state
+    u8 *active;              // runs the fast passes of the current step
+    u8 *fell;                // moved down by gravity in the current step
+    u8 *pass;                // inputs of the fast passes in the current step
+    u32 *list[BATCH_PASSES]; // games with each of them, by input bit
+    u32 *queue;              // games running tick() in the current step
+    u32 *pick;               // game of a candidate position
+    u8 *ctype;               // candidate positions, tested together
+    u8 *co;
+    i16 *cy;
+    i16 *cx;
+    u8 *ok;                  // candidates that fit
+    u8 *low;                 // and fit a row lower
+    u64 mask[TM_NUM + 1][TM_ORIENT][TM_COLS];  // board copy rows a position takes, in memory order
+    u8 pack[256][BATCH_LANES];                 // set bits of a mask of 8 games
+    u8 pack_num[256];                          // and their number
+} Batch;
+
+bool batch_init(Batch *batch, u32 num, u64 seed);
+void batch_free(Batch *batch);
+void batch_reset(Batch *batch, u32 lane, u64 seed);
+void batch_set(Batch *batch, u32 lane, const Game *game);
+void batch_get(const Batch *batch, u32 lane, Game *game);
+u32 batch_step(Batch *batch, const u16 *input);
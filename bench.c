@@ -0,0 +1,563 @@
+#define _GNU_SOURCE
+#include <curses.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "game.h"
+#include "draw.h"
+#include "replay.h"
+#include "tm_table.h"
+#include "stats.h"
+#include "placement.h"
+#include "pc.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "rollback.h"
+
+// Microbenchmarks of the engine and renderer hot paths on recorded boards.
+// Every benchmark is run as SAMPLES timed batches of the same number of
+// operations and prints one JSON line with the per operation percentiles.
+
+#define SAMPLES 101
+#define SAMPLE_NS 1000000  // minimal duration of a single batch
+#define MAX_BOARDS 256
+#define MAX_LINE_LEN 256
+#define PC_SEEDS 64        // perfect clear openers solved
+#define PC_PIECES 10
+#define BATCH_GAMES 1024   // games stepped together
+#define BATCH_FRAMES 256   // frames of inputs generated for them
+
+typedef struct Case {
+    u16 board;
+    Tetromino tm;
+} Case;
+
+typedef struct Cases {
+    Case *data;
+    u32 num;
+    u32 cap;
+} Cases;
+
+typedef struct Ctx {
+    Game board[MAX_BOARDS];   // recorded boards
+    Paint paint[MAX_BOARDS];  // their colors
+    Game full[MAX_BOARDS];    // the same boards with 1 to 4 bottom rows completed
+    u8 packed[MAX_BOARDS][SNAP_MAX]; // the boards packed by snap_pack()
+    size_t packed_size[MAX_BOARDS];
+    u32 board_num;
+    Cases probe;              // in-bounds positions, fitting or not
+    Cases fit;                // fitting positions
+    Game scratch;
+    Paint scratch_paint;
+    PlaceSearch search;
+    PcSolver pc;
+    u32 pc_seed;
+    Batch batch;
+    Game lanes[BATCH_GAMES];  // the same games ticked one by one
+    u16 input[BATCH_FRAMES][BATCH_GAMES];
+    u32 frame;
+    Rollback rb;
+    Display disp;
+    volatile u64 sink;        // keeps the results alive
+} Ctx;
+
+typedef struct Bench {
+    const char *name;
+    void (*run)(Ctx *ctx, u32 iters);
+    bool draws;               // needs the offscreen terminal
+    Vec screen;               // its size (rows, cols)
+} Bench;
+
+// xorshift64, shuffles the cases
+static u64 bench_rand(u64 *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void cases_add(Cases *cases, u16 board, Tetromino tm) {
+    if (cases->num == cases->cap) {
+        cases->cap = cases->cap ? cases->cap * 2 : 1024;
+        cases->data = realloc(cases->data, cases->cap * sizeof(Case));
+    }
+    cases->data[cases->num++] = (Case) { board, tm };
+}
+
+// Shuffles the cases so branches taken in a row are not predictable
+static void cases_shuffle(Cases *cases) {
+    u64 rng = 0x9e3779b97f4a7c15;
+    Case tmp;
+    for (u32 i = cases->num - 1; i > 0; i--) {
+        u32 j = bench_rand(&rng) % (i + 1);
+        tmp = cases->data[i];
+        cases->data[i] = cases->data[j];
+        cases->data[j] = tmp;
+    }
+}
+
+// Adds a board given as color rows
+static bool add_board(Ctx *ctx, u8 color[FIELD_Y][FIELD_X]) {
+    Game *game;
+
+    if (ctx->board_num == MAX_BOARDS)
+        return false;
+
+    game = &ctx->board[ctx->board_num];
+    memcpy(ctx->paint[ctx->board_num].color, color, sizeof(ctx->paint[0].color));
+    game_init(game, ++ctx->board_num);
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        game->board[y] = 0;
+        for (u8 x = 0; x < FIELD_X; x++) {
+            if (color[y][x] != BLACK)
+                game->board[y] |= 1 << x;
+        }
+    }
+    update_columns(game);
+    return true;
+}
+
+// Reads boards from a text file; 22 rows of '.' and "OZSLJTI" each,
+// separated with blank lines, lines starting with '#' are skipped
+static bool load_boards(Ctx *ctx, const char *path) {
+    static const char names[] = "OZSLJTI";
+    u8 color[FIELD_Y][FIELD_X];
+    char line[MAX_LINE_LEN];
+    const char *name;
+    u8 rows = 0;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#')
+            continue;
+        if (line[0] == '\n') {
+            if (rows != 0)
+                fprintf(stderr, "%s: incomplete board\n", path);
+            rows = 0;
+            continue;
+        }
+
+        for (u8 x = 0; x < FIELD_X; x++) {
+            name = strchr(names, line[x]);
+            color[rows][x] = line[x] != '\0' && name != NULL ? name - names : BLACK;
+        }
+        if (++rows == FIELD_Y) {
+            add_board(ctx, color);
+            rows = 0;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+// Takes the boards from every keyframe of a replay
+static bool load_replay(Ctx *ctx, const char *path) {
+    Replay rp;
+    Game game;
+    Paint paint;
+
+    if (!replay_open(&rp, path)) {
+        fprintf(stderr, "%s: not a valid replay\n", path);
+        return false;
+    }
+
+    for (u64 frame = 0; frame < rp.end_frame; frame += rp.keyframe_interval) {
+        game_init(&game, rp.seed);
+        paint_init(&paint);
+        if (!replay_seek(&rp, &game, &paint, frame)) {
+            fprintf(stderr, "%s: not a valid replay\n", path);
+            replay_close(&rp);
+            return false;
+        }
+        if (!add_board(ctx, paint.color))
+            break;
+    }
+
+    replay_close(&rp);
+    return true;
+}
+
+// Generates the tetromino positions tested on every board
+static void gen_cases(Ctx *ctx) {
+    const BoundingBox *bbox;
+    Tetromino tm;
+    u64 rng = 0x9e3779b97f4a7c15;
+
+    for (u16 b = 0; b < ctx->board_num; b++) {
+        for (u8 t = 0; t < TM_NUM; t++) {
+            for (u8 o = 0; o < TM_ORIENT; o++) {
+                bbox = &TM_SHAPE[t][o].bbox;
+                for (i16 y = -bbox->top; y + bbox->bottom < FIELD_Y; y++) {
+                    for (i16 x = -bbox->left; x + bbox->right < FIELD_X; x++) {
+                        tm = (Tetromino) { .type = t, .orientation = o, .pos = { y, x } };
+                        cases_add(&ctx->probe, b, tm);
+                        if (tm_fits(&ctx->board[b], &tm, (Vec) { 0, 0 }))
+                            cases_add(&ctx->fit, b, tm);
+                    }
+                }
+            }
+        }
+
+        // completing 1 to 4 of the bottom rows
+        ctx->full[b] = ctx->board[b];
+        for (u8 y = 0; y < b % 4 + 1; y++)
+            ctx->full[b].board[FIELD_Y - 1 - y] = FIELD_ROW_FULL;
+        update_columns(&ctx->full[b]);
+        ctx->packed_size[b] = snap_pack(&ctx->board[b], &ctx->paint[b], ctx->packed[b]);
+    }
+
+    cases_shuffle(&ctx->probe);
+    cases_shuffle(&ctx->fit);
+
+    // moves, rotations and soft drops every few frames, now and then a hard drop or a hold
+    for (u32 f = 0; f < BATCH_FRAMES; f++) {
+        for (u32 i = 0; i < BATCH_GAMES; i++) {
+            u64 r = bench_rand(&rng);
+            u16 input = 0;
+            input |= r % 8 == 0 ? IN_MV_LEFT : r % 8 == 1 ? IN_MV_RIGHT : 0;
+            input |= (r >> 8) % 16 == 0 ? IN_ROTATE_CW : (r >> 8) % 16 == 1 ? IN_ROTATE_CCW : 0;
+            input |= (r >> 16) % 8 == 0 ? IN_SOFT_DROP : 0;
+            input |= (r >> 24) % 64 == 0 ? IN_HARD_DROP : 0;
+            input |= (r >> 32) % 256 == 0 ? IN_HOLD : 0;
+            ctx->input[f][i] = input;
+        }
+    }
+    for (u32 i = 0; i < BATCH_GAMES; i++)
+        game_init(&ctx->lanes[i], i + 1);
+}
+
+// Places a case's tetromino on its board, in the air
+static Game *place(Ctx *ctx, Case *c) {
+    Game *game = &ctx->board[c->board];
+    game->tm_field = c->tm;
+    game->on_floor = false;
+    game->floor_counter = FLOOR_MOVES;
+    game->entry_delay = 0;
+    return game;
+}
+
+static void run_tm_fits(Ctx *ctx, u32 iters) {
+    u32 hits = 0, j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        Case *c = &ctx->probe.data[j];
+        hits += tm_fits(&ctx->board[c->board], &c->tm, (Vec) { 1, 0 });
+        if (++j == ctx->probe.num)
+            j = 0;
+    }
+    ctx->sink += hits;
+}
+
+static void run_tm_rotate(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        Game *game = place(ctx, &ctx->fit.data[j]);
+        tm_rotate(game, i & 1);
+        ctx->sink += game->tm_field.pos.x;
+        if (++j == ctx->fit.num)
+            j = 0;
+    }
+}
+
+static void run_hard_drop(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        Game *game = place(ctx, &ctx->fit.data[j]);
+        hard_drop(game);
+        ctx->sink += game->tm_field.pos.y;
+        if (++j == ctx->fit.num)
+            j = 0;
+    }
+}
+
+static void run_clear_lines(Ctx *ctx, u32 iters) {
+    Game *game = &ctx->scratch;
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        memcpy(game->board, ctx->full[j].board, sizeof(game->board));
+        memcpy(game->column, ctx->full[j].column, sizeof(game->column));
+        clear_lines(game, FIELD_Y - 4, FIELD_Y - 1);
+        ctx->sink += game->board[FIELD_Y - 1];
+        if (++j == ctx->board_num)
+            j = 0;
+    }
+}
+
+// Searches the placements of every tetromino type spawned on every board
+static void run_find_placements(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    Tetromino tm;
+    for (u32 i = 0; i < iters; i++) {
+        tm = (Tetromino) { .type = j % TM_NUM, .orientation = 0, .pos = { 0, TM_SHAPE[j % TM_NUM][0].spawn_x } };
+        ctx->sink += find_placements(&ctx->search, &ctx->board[j / TM_NUM], &tm);
+        if (++j == ctx->board_num * TM_NUM)
+            j = 0;
+    }
+}
+
+// Solves the perfect clear openers of seeded games,
+// an operation is a position searched
+static void run_pc_solve(Ctx *ctx, u32 iters) {
+    u8 queue[PC_QUEUE_MAX], num;
+    u64 nodes = 0;
+
+    while (nodes < iters) {
+        game_init(&ctx->scratch, ctx->pc_seed + 1);
+        num = pc_queue(&ctx->scratch, queue, PC_QUEUE_MAX);
+        ctx->pc.max_nodes = iters - nodes;
+        ctx->sink += pc_solve(&ctx->pc, &ctx->scratch, queue, num, PC_PIECES);
+        nodes += ctx->pc.nodes;
+        ctx->pc_seed = (ctx->pc_seed + 1) % PC_SEEDS;
+    }
+}
+
+static void run_snapshot_copy(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        ctx->scratch = ctx->board[j];
+        ctx->sink += ctx->scratch.hash;
+        if (++j == ctx->board_num)
+            j = 0;
+    }
+}
+
+static void run_snapshot_pack(Ctx *ctx, u32 iters) {
+    u8 buf[SNAP_MAX];
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        ctx->sink += snap_pack(&ctx->board[j], &ctx->paint[j], buf);
+        if (++j == ctx->board_num)
+            j = 0;
+    }
+}
+
+static void run_snapshot_unpack(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        ctx->sink += snap_unpack(&ctx->scratch, &ctx->scratch_paint, ctx->packed[j], ctx->packed_size[j]);
+        if (++j == ctx->board_num)
+            j = 0;
+    }
+}
+
+// Ticks the games one by one, an operation is a frame of a game
+static void run_batch_tick(Ctx *ctx, u32 iters) {
+    for (u32 n = 0; n < iters; n += BATCH_GAMES) {
+        const u16 *input = ctx->input[ctx->frame];
+        for (u32 i = 0; i < BATCH_GAMES; i++)
+            if (!tick(&ctx->lanes[i], input[i]))
+                game_init(&ctx->lanes[i], ctx->lanes[i].rng);
+        ctx->frame = (ctx->frame + 1) % BATCH_FRAMES;
+    }
+}
+
+// Steps the games together, an operation is a frame of a game
+static void run_batch_step(Ctx *ctx, u32 iters) {
+    Batch *batch = &ctx->batch;
+    for (u32 n = 0; n < iters; n += BATCH_GAMES) {
+        if (batch_step(batch, ctx->input[ctx->frame]) < BATCH_GAMES)
+            for (u32 i = 0; i < BATCH_GAMES; i++)
+                if (batch->done[i])
+                    batch_reset(batch, i, batch->game[i].rng);
+        ctx->frame = (ctx->frame + 1) % BATCH_FRAMES;
+    }
+}
+
+// Rolls a versus game back over the whole window every frame, the remote input
+// of the oldest unconfirmed frame never being the predicted one; an operation
+// is a rollback, which has to fit in a frame
+static void run_rollback(Ctx *ctx, u32 iters) {
+    Rollback *rb = &ctx->rb;
+    u16 *input;
+
+    for (u32 i = 0; i < iters; i++) {
+        if (rb->vs.lost != 0 || rb->frame == 0)
+            rb_init(rb, rb->frame + 1, 0);
+        while (rb_ready(rb)) {
+            rb_advance(rb, ctx->input[ctx->frame][0]);
+            ctx->frame = (ctx->frame + 1) % BATCH_FRAMES;
+        }
+        input = ctx->input[rb->confirmed % BATCH_FRAMES];
+        rb_remote(rb, rb->confirmed, input[1] != (rb->last & RB_HELD) ? input[1] : input[1] ^ IN_MV_RIGHT);
+        ctx->sink += rb_sync(rb);
+    }
+}
+
+static void run_tm_draw_ghost(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        Case *c = &ctx->fit.data[j];
+        tm_draw_ghost(ctx->disp.win[WIN_FIELD], ctx->disp.block_size, &ctx->board[c->board], &c->tm);
+        if (++j == ctx->fit.num)
+            j = 0;
+    }
+}
+
+static void run_draw_game(Ctx *ctx, u32 iters) {
+    u32 j = 0;
+    for (u32 i = 0; i < iters; i++) {
+        Game *game = place(ctx, &ctx->fit.data[j]);
+        draw_game(&ctx->disp, game, &ctx->paint[ctx->fit.data[j].board]);
+        if (++j == ctx->fit.num)
+            j = 0;
+    }
+}
+
+// Redraws a game that did not change since the last frame
+static void run_draw_idle(Ctx *ctx, u32 iters) {
+    Game *game = place(ctx, &ctx->fit.data[0]);
+    for (u32 i = 0; i < iters; i++)
+        draw_game(&ctx->disp, game, &ctx->paint[ctx->fit.data[0].board]);
+}
+
+static const Bench BENCHES[] = {
+    { "tm_fits",           run_tm_fits,           false, { 0, 0 } },
+    { "tm_rotate",         run_tm_rotate,         false, { 0, 0 } },
+    { "hard_drop",         run_hard_drop,         false, { 0, 0 } },
+    { "clear_lines",       run_clear_lines,       false, { 0, 0 } },
+    { "find_placements",   run_find_placements,   false, { 0, 0 } },
+    { "pc_solve",          run_pc_solve,          false, { 0, 0 } },
+    { "snapshot/copy",     run_snapshot_copy,     false, { 0, 0 } },
+    { "snapshot/pack",     run_snapshot_pack,     false, { 0, 0 } },
+    { "snapshot/unpack",   run_snapshot_unpack,   false, { 0, 0 } },
+    { "batch/tick",        run_batch_tick,        false, { 0, 0 } },
+    { "batch/step",        run_batch_step,        false, { 0, 0 } },
+    { "rollback",          run_rollback,          false, { 0, 0 } },
+    { "tm_draw_ghost",     run_tm_draw_ghost,     true,  { 24, 80 } },
+    { "draw_game/small",   run_draw_game,         true,  { 24, 80 } },
+    { "draw_game/large",   run_draw_game,         true,  { 50, 120 } },
+    { "draw_game/idle",    run_draw_idle,         true,  { 24, 80 } },
+};
+
+// Opens a terminal writing to /dev/null
+static bool init_offscreen() {
+    static const char *terms[] = { "xterm-256color", "xterm", "vt100" };
+    FILE *out = fopen("/dev/null", "w");
+    FILE *in = fopen("/dev/null", "r");
+    SCREEN *screen = NULL;
+
+    for (u8 i = 0; i < sizeof(terms) / sizeof(terms[0]) && screen == NULL; i++)
+        screen = newterm(terms[i], out, in);
+    if (screen == NULL)
+        return false;
+
+    set_term(screen);
+    setup_screen();
+    return true;
+}
+
+// Resizes the offscreen terminal and recreates the windows
+static void setup_windows(Ctx *ctx, Vec screen) {
+    for (u8 w = 0; w < WINDOW_NUM; w++)
+        if (ctx->disp.win[w] != NULL)
+            delwin(ctx->disp.win[w]);
+
+    resize_term(screen.y, screen.x);
+    init_display(&ctx->disp, 0, 1);
+}
+
+static int cmp_f64(const void *a, const void *b) {
+    f64 x = *(const f64 *) a, y = *(const f64 *) b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(Ctx *ctx, const Bench *bench) {
+    f64 ns[SAMPLES];
+    u64 start, elapsed;
+    u32 iters = 64;
+
+    // calibrating the batch size
+    for (;;) {
+        start = now_ns();
+        bench->run(ctx, iters);
+        elapsed = now_ns() - start;
+        if (elapsed >= SAMPLE_NS || iters >= UINT32_MAX / 2)
+            break;
+        iters *= 2;
+    }
+
+    for (u32 s = 0; s < SAMPLES; s++) {
+        start = now_ns();
+        bench->run(ctx, iters);
+        ns[s] = (f64) (now_ns() - start) / iters;
+    }
+    qsort(ns, SAMPLES, sizeof(f64), cmp_f64);
+
+    printf("{\"bench\": \"%s\", \"iters\": %u, \"samples\": %u, "
+           "\"ns_min\": %.2f, \"ns_p50\": %.2f, \"ns_p90\": %.2f, \"ns_p99\": %.2f, "
+           "\"ops_per_sec\": %.0f}\n",
+           bench->name, iters, SAMPLES,
+           ns[0], ns[SAMPLES / 2], ns[SAMPLES * 90 / 100], ns[SAMPLES * 99 / 100],
+           1.0e9 / ns[SAMPLES / 2]);
+    fflush(stdout);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-c cpu] [-f filter] [-r replay]... [boards]...\n", name);
+}
+
+int main(int argc, char **argv) {
+    static Ctx ctx;
+    const char *filter = NULL;
+    bool offscreen = false;
+    cpu_set_t cpus;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:f:r:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                CPU_ZERO(&cpus);
+                CPU_SET(atoi(optarg), &cpus);
+                if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+                    perror("sched_setaffinity");
+                break;
+            case 'f': filter = optarg; break;
+            case 'r':
+                if (!load_replay(&ctx, optarg))
+                    return 1;
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++)
+        if (!load_boards(&ctx, argv[i]))
+            return 1;
+
+    if (ctx.board_num == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    gen_cases(&ctx);
+    if (!pc_init(&ctx.pc) || !batch_init(&ctx.batch, BATCH_GAMES, 1)) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    for (u8 b = 0; b < sizeof(BENCHES) / sizeof(BENCHES[0]); b++) {
+        const Bench *bench = &BENCHES[b];
+        if (filter != NULL && strstr(bench->name, filter) == NULL)
+            continue;
+
+        if (bench->draws) {
+            if (!offscreen && !(offscreen = init_offscreen())) {
+                fprintf(stderr, "no terminal description for the offscreen screen\n");
+                return 1;
+            }
+            setup_windows(&ctx, bench->screen);
+        }
+        run_bench(&ctx, bench);
+    }
+
+    if (offscreen)
+        endwin();
+    batch_free(&ctx.batch);
+    return 0;
+}
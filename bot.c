@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "tm_table.h"
+
+// Value of a line that tops out
+#define BOT_LOST (-1.0e9f)
+
+// Default weights, compare others with tetris-sim -p bot
+const BotWeights BOT_WEIGHTS = {
+    .height = -0.51f,
+    .holes = -0.36f,
+    .bumpiness = -0.18f,
+    .wells = -0.05f,
+    .lines = 0.76f,
+    .tetris = 1.5f,
+};
+
+static u64 bot_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// A tetromino of a given type as it spawns
+static Tetromino spawn(u8 type) {
+    return (Tetromino) { .type = type, .orientation = 0, .pos = { 0, TM_SHAPE[type][0].spawn_x } };
+}
+
+// Scores a board by its column heights, holes and wells
+static f32 evaluate(const BotWeights *w, const u32 column[FIELD_X]) {
+    u8 height[FIELD_X], low;
+    u32 total = 0, holes = 0, bumpiness = 0, wells = 0;
+
+    for (u8 x = 0; x < FIELD_X; x++) {
+        height[x] = column[x] != 0 ? FIELD_Y - __builtin_ctz(column[x]) : 0;
+        total += height[x];
+        holes += height[x] - __builtin_popcount(column[x]);
+    }
+    for (u8 x = 0; x < FIELD_X; x++) {
+        if (x > 0)
+            bumpiness += abs(height[x] - height[x - 1]);
+        low = x > 0 ? height[x - 1] : FIELD_Y;
+        if (x < FIELD_X - 1 && height[x + 1] < low)
+            low = height[x + 1];
+        if (low > height[x])
+            wells += low - height[x];
+    }
+
+    return w->height * total + w->holes * holes + w->bumpiness * bumpiness + w->wells * wells;
+}
+
+// Checks whether two nodes stand for the same position of the search
+inline static bool same_node(BotNode *a, BotNode *b) {
+    return a->hash == b->hash && a->piece == b->piece && a->hold == b->hold && a->done == b->done;
+}
+
+// Inserts a node into a list sorted from the best one, keeping at most max of them;
+// a node already in the list is kept once, with the better value
+static void keep_best(BotNode *list, u8 *num, u8 max, BotNode *node) {
+    u8 i;
+
+    for (i = 0; i < *num && !same_node(&list[i], node); i++);
+    if (i < *num) {
+        if (node->value <= list[i].value)
+            return;
+    } else if (*num == max) {
+        if (node->value <= list[max - 1].value)
+            return;
+        i = max - 1;
+    } else {
+        i = (*num)++;
+    }
+
+    for (; i > 0 && list[i - 1].value < node->value; i--)
+        list[i] = list[i - 1];
+    list[i] = *node;
+}
+
+// Adds the boards after every placement of a tetromino to the best children
+// of a node; first marks the moves made from the current game
+static void expand(Bot *bot, BotScratch *s, BotNode *node, Tetromino *start, bool first,
+                   BotNode *list, u8 *num, u8 max) {
+    BotNode child;
+    u16 places;
+    u8 lines;
+
+    memcpy(s->game.column, node->column, sizeof(node->column));
+    places = find_placements(&s->ps, &s->game, start);
+    for (u16 i = 0; i < places; i++) {
+        child = *node;
+        lines = placement_lock(child.column, &child.hash, &s->ps.place[i]);
+        child.reward += bot->weights.lines * lines + (lines == 4 ? bot->weights.tetris : 0);
+        child.value = child.reward + evaluate(&bot->weights, child.column);
+        if (first)
+            child.first = s->ps.place[i];
+        keep_best(list, num, max, &child);
+    }
+}
+
+// Looks up a value of the transposition table
+static bool cache_get(Bot *bot, u64 key, f32 *value) {
+    u64 data;
+
+    if (!tt_probe(&bot->tt, key, &data))
+        return false;
+    memcpy(value, &data, sizeof(*value));
+    return true;
+}
+
+static void cache_put(Bot *bot, u64 key, f32 value) {
+    u64 data = 0;
+
+    memcpy(&data, &value, sizeof(value));
+    tt_store(&bot->tt, key, data);
+}
+
+// Value of the best placement of a tetromino on the board of a node
+// with no reward, BOT_LOST when it has none
+static f32 place_value(Bot *bot, BotScratch *s, BotNode *node, u8 type) {
+    u64 key = node->hash ^ ZOBRIST_PIECE[type];
+    Tetromino start = spawn(type);
+    BotNode best;
+    f32 value;
+    u8 num = 0;
+
+    if (cache_get(bot, key, &value))
+        return value;
+
+    expand(bot, s, node, &start, false, &best, &num, 1);
+    value = num != 0 ? best.value : BOT_LOST;
+    cache_put(bot, key, value);
+    return value;
+}
+
+// Expected value of the board of a node, not counting its reward, over every
+// tetromino that can come next, each one placed (or swapped with the held one)
+// the best way
+static f32 expect(Bot *bot, BotScratch *s, BotNode *node) {
+    BotNode option = *node;
+    u64 key = node->hash ^ ZOBRIST_HOLD[node->hold];
+    f32 value[TM_NUM], sum = 0;
+
+    if (cache_get(bot, key, &sum))
+        return sum;
+
+    option.reward = 0;
+    for (u8 t = 0; t < TM_NUM; t++)
+        value[t] = place_value(bot, s, &option, t);
+    for (u8 t = 0; t < TM_NUM; t++)
+        sum += node->hold != BLACK && value[node->hold] > value[t] ? value[node->hold] : value[t];
+
+    sum /= TM_NUM;
+    cache_put(bot, key, sum);
+    return sum;
+}
+
+// Expands a node of the beam into its best children
+static void bot_task(void *ctx, u32 task, u32 worker) {
+    Bot *bot = ctx;
+    BotScratch *s = &bot->scratch[worker];
+    BotNode *node = &bot->parent[task], option = *node;
+    Tetromino start;
+
+    bot->child_num[task] = 0;
+    bot->late[task] = false;
+    if (node->done) {
+        bot->child[task][bot->child_num[task]++] = *node;
+        return;
+    }
+    if (bot_clock() > bot->deadline) {
+        bot->late[task] = true;
+        return;
+    }
+
+    if (node->piece == BLACK) {
+        option.value = node->reward + expect(bot, s, node);
+        option.done = true;
+        bot->child[task][bot->child_num[task]++] = option;
+        return;
+    }
+
+    option.piece = BLACK;
+    start = spawn(node->piece);
+    expand(bot, s, &option, &start, false, bot->child[task], &bot->child_num[task], BOT_BEAM);
+    if (node->hold != BLACK && node->hold != node->piece) {
+        option.hold = node->piece;
+        start = spawn(node->hold);
+        expand(bot, s, &option, &start, false, bot->child[task], &bot->child_num[task], BOT_BEAM);
+    }
+}
+
+// Takes the next step of a perfect clear, searching for a new one when the
+// board or the field tetromino is not the one of the step
+static bool follow_pc(Bot *bot, Game *game, u64 board) {
+    PcSolver *pc = bot->pc;
+    u8 queue[PC_QUEUE_MAX], num;
+    PcStep *step = &pc->step[bot->pc_step];
+
+    if (bot->pc_step >= pc->step_num || step->board != board || step->piece != game->tm_field.type) {
+        num = pc_queue(game, queue, PC_QUEUE_MAX);
+        if (pc_solve(pc, game, queue, num, bot->pc_pieces) != PC_FOUND) {
+            pc->step_num = 0;
+            return false;
+        }
+        bot->pc_found++;
+        bot->pc_step = 0;
+        step = &pc->step[0];
+    }
+
+    bot->pc_step++;
+    bot->hold = step->hold;
+    bot->target = step->place;
+    return true;
+}
+
+// Searches for the best placement of the field tetromino, or of the one
+// a hold brings in, looking ahead as far as the time budget allows
+static void bot_plan(Bot *bot, Game *game) {
+    BotScratch *s = &bot->scratch[0];
+    BotNode root = { .piece = game->tm_next.type, .hold = game->tm_hold.type }, merged[BOT_BEAM];
+    Tetromino *start;
+    bool late, done;
+    u8 merged_num;
+
+    bot->deadline = bot->budget_ns != 0 ? bot_clock() + bot->budget_ns : UINT64_MAX;
+    bot->plans++;
+
+    memcpy(root.column, game->column, sizeof(root.column));
+    root.hash = game->hash ^ ZOBRIST_PIECE[game->tm_field.type] ^ ZOBRIST_HOLD[game->tm_hold.type]
+              ^ ZOBRIST_BAG[game->bag_index];
+    bot->planned = true;
+    if (bot->pc != NULL && follow_pc(bot, game, root.hash))
+        return;
+
+    bot->parent_num = 0;
+    expand(bot, s, &root, &game->tm_field, true, bot->parent, &bot->parent_num, BOT_BEAM);
+    if (!game->swapped && !bot->held) {
+        root.first_hold = true;
+        root.hold = game->tm_field.type;
+        if (game->tm_hold.type != BLACK) {
+            start = &game->tm_hold;
+        } else {
+            start = &game->tm_next;
+            root.piece = BLACK;
+        }
+        expand(bot, s, &root, start, true, bot->parent, &bot->parent_num, BOT_BEAM);
+    }
+
+    for (done = false; bot->parent_num > 0 && !done;) {
+        if (bot->pool != NULL) {
+            pool_run(bot->pool, bot->parent_num, bot_task, bot);
+        } else {
+            for (u8 p = 0; p < bot->parent_num; p++)
+                bot_task(bot, p, 0);
+        }
+
+        late = false;
+        for (u8 p = 0; p < bot->parent_num; p++)
+            late |= bot->late[p];
+        if (late) {
+            bot->cut++;
+            break;
+        }
+
+        merged_num = 0;
+        done = true;
+        for (u8 p = 0; p < bot->parent_num; p++) {
+            for (u8 c = 0; c < bot->child_num[p]; c++) {
+                keep_best(merged, &merged_num, BOT_BEAM, &bot->child[p][c]);
+                done &= bot->child[p][c].done;
+            }
+        }
+        memcpy(bot->parent, merged, merged_num * sizeof(BotNode));
+        bot->parent_num = merged_num;
+    }
+
+    bot->hold = bot->parent_num > 0 && bot->parent[0].first_hold;
+    bot->target = bot->parent_num > 0 ? bot->parent[0].first : (Tetromino) { .type = BLACK };
+}
+
+// Position of an input in the order tick() handles them
+static u8 input_rank(u8 input) {
+    switch (input) {
+        case IN_ROTATE_CW:  return 0;
+        case IN_ROTATE_CCW: return 1;
+        case IN_MV_LEFT:    return 2;
+        case IN_MV_RIGHT:   return 3;
+        case IN_SOFT_DROP:  return 4;
+        default:            return 5;
+    }
+}
+
+bool bot_init(Bot *bot, Pool *pool, u64 budget_ns) {
+    memset(bot, 0, sizeof(Bot));
+    bot->scratch = calloc(pool != NULL ? pool_workers(pool) : 1, sizeof(BotScratch));
+    if (bot->scratch == NULL)
+        return false;
+    if (!tt_init(&bot->tt, BOT_TT_BITS)) {
+        bot_free(bot);
+        return false;
+    }
+
+    bot->pool = pool;
+    bot->weights = BOT_WEIGHTS;
+    bot->budget_ns = budget_ns;
+    return true;
+}
+
+void bot_free(Bot *bot) {
+    free(bot->scratch);
+    bot->scratch = NULL;
+    tt_free(&bot->tt);
+    if (bot->pc != NULL)
+        pc_free(bot->pc);
+    free(bot->pc);
+    bot->pc = NULL;
+}
+
+// Turns on the perfect clear mode, with perfect clears of up to max_pieces
+bool bot_perfect_clears(Bot *bot, u8 max_pieces) {
+    if (bot->pc == NULL && ((bot->pc = malloc(sizeof(PcSolver))) == NULL || !pc_init(bot->pc))) {
+        free(bot->pc);
+        bot->pc = NULL;
+        return false;
+    }
+
+    bot->pc->max_nodes = BOT_PC_NODES;
+    bot->pc_pieces = max_pieces;
+    return true;
+}
+
+// Returns the input of the bot for the next tick: the inputs of the path
+// to its target that a single tick handles in their order
+u16 bot_input(Bot *bot, Game *game) {
+    PlaceSearch *ps = &bot->scratch[0].ps;
+    u8 path[BOT_PATH_MAX], len, i, j;
+    u16 index = 0, input = IN_NONE;
+
+    if (game->over || game->entry_delay > 0 || game->tm_field.type == BLACK) {
+        bot->planned = false;
+        bot->held = false;
+        return IN_NONE;
+    }
+
+    if (bot->planned && bot->target.type == game->tm_field.type) {
+        find_placements(ps, game, &game->tm_field);
+        index = placement_find(ps, &bot->target);
+    }
+    if (!bot->planned || bot->target.type != game->tm_field.type || index == ps->place_num) {
+        bot_plan(bot, game);
+        if (bot->hold) {
+            bot->hold = false;
+            bot->held = true;
+            return IN_HOLD;
+        }
+        if (bot->target.type == BLACK)
+            return IN_NONE;
+        find_placements(ps, game, &game->tm_field);
+        index = placement_find(ps, &bot->target);
+    }
+
+    len = index < ps->place_num ? placement_path(ps, index, path, sizeof(path)) : 0;
+    if (len == 0)
+        return IN_HARD_DROP;
+
+    for (i = 0; i < len; i++) {
+        // the rest drops straight onto the target
+        for (j = i; path[j] == IN_SOFT_DROP; j++);
+        if (path[j] == IN_HARD_DROP)
+            return input | IN_HARD_DROP;
+        if (i > 0 && input_rank(path[i]) <= input_rank(path[i - 1]))
+            break;
+        input |= path[i];
+    }
+
+    return input;
+}
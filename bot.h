@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include "game.h"
+#include "pc.h"
+#include "placement.h"
+#include "pool.h"
+#include "tt.h"
+
+// Computer player. When a tetromino spawns it runs a beam search over the
+// placements of the field tetromino, the next one and the held one, ending
+// with an expectimax over the unknown tetromino that follows. Boards are
+// scored by a weighted heuristic. The search levels run in parallel on a
+// pool, until the per tetromino time budget runs out. Boards reached through
+// different placement orders are merged by their Zobrist hash, and the
+// expectations go to a transposition table the workers share, so they carry
+// over to the next searches too. The chosen placement is then reached
+// through tick() like a human would: every frame the path is searched again
+// from the current position, so gravity can't derail it.
+// In perfect clear mode the bot first asks the solver for a perfect clear
+// with the queue the randomizer deals, and follows it when there is one.
+
+#define BOT_BEAM 12           // boards kept on every level of the search
+#define BOT_PATH_MAX 64
+#define BOT_BUDGET_NS (1000000000 / FRAMERATE / 2)
+#define BOT_TT_BITS 16        // 2^16 cached expectations
+#define BOT_PC_NODES 4000     // perfect clear search limit per tetromino
+
+typedef struct BotWeights {
+    f32 height;    // sum of the column heights
+    f32 holes;     // empty cells under the column tops
+    f32 bumpiness; // height differences of neighbouring columns
+    f32 wells;     // depth of the columns lower than both of their neighbours
+    f32 lines;     // every cleared line
+    f32 tetris;    // four lines cleared at once
+} BotWeights;
+
+typedef struct BotNode {
+    u32 column[FIELD_X];
+    u64 hash;         // Zobrist hash of the board
+    f32 reward;       // line clear rewards on the way to the board
+    f32 value;        // the reward and the evaluation of the board
+    u8 piece;         // tetromino to place next, BLACK when not known yet
+    u8 hold;          // held tetromino, BLACK when none
+    bool done;        // value is the expectation over the unknown tetromino
+    bool first_hold;  // the first move starts with a hold
+    Tetromino first;  // placement of the first move
+} BotNode;
+
+typedef struct BotScratch {
+    PlaceSearch ps;
+    Game game;
+} BotScratch;
+
+typedef struct Bot {
+    Pool *pool;             // NULL searches on the calling thread
+    BotScratch *scratch;    // one per worker
+    BotWeights weights;
+    Tt tt;                  // expectations by board and held tetromino
+    u64 budget_ns;          // search time per tetromino, 0 for no limit
+    u64 deadline;
+    BotNode parent[BOT_BEAM];
+    u8 parent_num;
+    BotNode child[BOT_BEAM][BOT_BEAM]; // best children of every parent
+    u8 child_num[BOT_BEAM];
+    bool late[BOT_BEAM];    // the parent was not expanded in time
+    bool planned;
+    bool hold;              // hold before moving to the target
+    bool held;              // already held this tetromino
+    Tetromino target;
+    PcSolver *pc;           // perfect clear mode, NULL when off
+    u8 pc_pieces;           // longest perfect clear searched
+    u8 pc_step;             // next step of the perfect clear followed
+    u64 plans;
+    u64 cut;                // plans cut short by the budget
+    u64 pc_found;           // perfect clears found
+} Bot;
+
+extern const BotWeights BOT_WEIGHTS;
+
+bool bot_init(Bot *bot, Pool *pool, u64 budget_ns);
+void bot_free(Bot *bot);
+bool bot_perfect_clears(Bot *bot, u8 max_pieces);
+u16 bot_input(Bot *bot, Game *game);
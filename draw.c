@@ -1,36 +1,56 @@
 #include <curses.h>
+#include <inttypes.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "draw.h"
 #include "utils.h"
 #include "game.h"
+#include "tm_table.h"
+#include "win_loc_dim.h"
+
+static const Vec BLOCK_SIZE[BLOCK_SIZE_NUM] = BLOCK_SIZES;
+
+// Returns the character a field cell is drawn with
+static chtype cell_char(u8 cell) {
+    if (cell == BLACK)
+        return ' ';
+    if (cell == GRAY)
+        return GARBAGE_CHAR;
+    if (cell & CELL_GHOST)
+        return GHOST_CHAR | COLOR_PAIR(cell & ~CELL_GHOST);
+    return DRAW_CHAR | COLOR_PAIR(cell);
+}
 
 // Draws a singular block
 static void block_draw(WINDOW *win, Vec block_size, Vec pos, u8 color, bool ghost) {
+    chtype span[MAX_BLOCK_X];
+
     if (color == BLACK)
         return;
     if (pos.x < 0 || pos.y < 0)
         return;
 
-    if (!ghost) {
-        for (u8 y = 0; y < block_size.y; y++) {
-            wmove(win, pos.y + y, pos.x);
-            for (u8 x = 0; x < block_size.x; x++) {
-                waddch(win, DRAW_CHAR | COLOR_PAIR(color));
-            }
-        }
-    } else {
-        for (u8 y = 0; y < block_size.y; y++) {
-            wmove(win, pos.y + y, pos.x);
-            for (u8 x = 0; x < block_size.x; x++) {
-                waddch(win, GHOST_CHAR | COLOR_PAIR(color));
-            }
-        }
-        
+    for (u8 x = 0; x < block_size.x; x++)
+        span[x] = cell_char(ghost ? color | CELL_GHOST : color);
+    for (u8 y = 0; y < block_size.y; y++)
+        mvwaddchnstr(win, pos.y + y, pos.x, span, block_size.x);
+}
+
+// Draws a row of field cells, one span per line of the window
+static void row_draw(WINDOW *w_field, Vec block_size, u8 y, const u8 cell[FIELD_X]) {
+    chtype span[FIELD_X * MAX_BLOCK_X];
+    u16 len = 0;
+
+    for (u8 x = 0; x < FIELD_X; x++) {
+        chtype ch = cell_char(cell[x]);
+        for (u8 i = 0; i < block_size.x; i++)
+            span[len++] = ch;
     }
 
-    wnoutrefresh(win);
+    for (u8 line = 0; line < block_size.y; line++)
+        mvwaddchnstr(w_field, BORDER_THICKNESS + y * block_size.y + line, BORDER_THICKNESS, span, len);
 }
 
 // Draws a tetromino
@@ -38,77 +58,76 @@ void tm_draw(WINDOW *win, Vec block_size, Tetromino *tm, bool ghost) {
     if (tm->type == BLACK)
         return;
 
+    const Vec *block = TM_SHAPE[tm->type][tm->orientation].block;
     Vec drawing_pos;
     for (u8 i = 0; i < TM_SIZE; i++) {
-        drawing_pos.y = block_size.y * (tm->pos.y + tm->block[i].y - FIELD_UM) + BORDER_THICKNESS;
-        drawing_pos.x = block_size.x * (tm->pos.x + tm->block[i].x) + BORDER_THICKNESS;
+        drawing_pos.y = block_size.y * (tm->pos.y + block[i].y - FIELD_UM) + BORDER_THICKNESS;
+        drawing_pos.x = block_size.x * (tm->pos.x + block[i].x) + BORDER_THICKNESS;
         block_draw(win, block_size, drawing_pos, tm->type, ghost);
     }
 }
 
 // Draws a tetromino onto Next and Hold windows
 void tm_nh_draw(WINDOW *win, Vec block_size, Tetromino *tm) {
+    if (tm->type == BLACK)
+        return;
+
+    const Vec *block = TM_SHAPE[tm->type][tm->orientation].block;
     Vec drawing_pos;
+    u8 size = 0;
+
+    while (size < BLOCK_SIZE_NUM - 1 && BLOCK_SIZE[size].y != block_size.y)
+        size++;
 
     for (u8 i = 0; i < TM_SIZE; i++) {
-        drawing_pos = tm->pos_nh;
-        drawing_pos.y += block_size.y * tm->block[i].y;
-        drawing_pos.x += block_size.x * tm->block[i].x;
+        drawing_pos = TM_NH_POS[size][tm->type][tm->orientation];
+        drawing_pos.y += block_size.y * block[i].y;
+        drawing_pos.x += block_size.x * block[i].x;
         block_draw(win, block_size, drawing_pos, tm->type, false);
     }
 }
 
-// Draws a ghost tetromino; it's final position when hard dropped
+// Returns the ghost of a tetromino; it's final position when hard dropped
+static Tetromino tm_ghost(Game *game, Tetromino *tm) {
+    Tetromino ghost = *tm;
+    ghost.pos.y += tm_drop_distance(game, tm);
+    return ghost;
+}
+
+// Draws a ghost tetromino
 void tm_draw_ghost(WINDOW *win, Vec block_size, Game *game, Tetromino *tm) {
-    Tetromino tm_ghost = *tm;
-    while (tm_fits(game, &tm_ghost, (Vec) { 1, 0 }))
-        tm_ghost.pos.y++;
-    tm_draw(win, block_size, &tm_ghost, true);
+    Tetromino ghost = tm_ghost(game, tm);
+    tm_draw(win, block_size, &ghost, true);
 }
 
 // Draws the entire game field
-void field_draw(WINDOW *w_field, Vec block_size, Game *game) {
-    Vec pos = { BORDER_THICKNESS, BORDER_THICKNESS };
-    bool prev = false;
-
-    for (u8 y = FIELD_UM; y < FIELD_Y; y++) {
-        for (u8 x = 0; x < FIELD_X; x++) {
-            block_draw(w_field, block_size, pos, game->field[y][x], prev);
-            pos.x += block_size.x;
-        }
-        pos.x = BORDER_THICKNESS;
-        pos.y += block_size.y;
-        prev = false;
-    } 
+void field_draw(WINDOW *w_field, Vec block_size, const Paint *paint) {
+    for (u8 y = FIELD_UM; y < FIELD_Y; y++)
+        row_draw(w_field, block_size, y - FIELD_UM, paint->color[y]);
 }
 
 // Prints the score to the given window
 void print_score(WINDOW *w_score, u32 score) {
     mvwprintw(w_score, BORDER_THICKNESS, BORDER_THICKNESS, "%i", score);
-    wnoutrefresh(w_score);
 }
 
 // Prints the level to the given window
 void print_level(WINDOW *w_level, u8 level) {
     mvwprintw(w_level, BORDER_THICKNESS, BORDER_THICKNESS, "%hi", level);
-    wnoutrefresh(w_level);
 }
 
 // Prints the pause screen
-void print_pause(WINDOW *win, Game *game) {
-    move(BORDER_THICKNESS, BORDER_THICKNESS);
-    for (u8 y = 0; y < (FIELD_Y - FIELD_UM) * game->block_size.y; y++) {
-        for (u8 x = 0; x < FIELD_X * game->block_size.x; x++)
-            addch(PAUSE_CHAR);
-        move(BORDER_THICKNESS + (y + 1), BORDER_THICKNESS);
-    }
+void print_pause(WINDOW *win, Vec block_size) {
+    for (u8 y = 0; y < (FIELD_Y - FIELD_UM) * block_size.y; y++)
+        mvhline(BORDER_THICKNESS + y, BORDER_THICKNESS, PAUSE_CHAR, FIELD_X * block_size.x);
 
     border_draw(win, "PAUSED");
+    wnoutrefresh(win);
 }
 
 // Pauses the game
-bool pause_game(WINDOW *w_field, Game *game, i16 *ch) {
-    print_pause(w_field, game);
+bool pause_game(Display *disp, Game *game, const Paint *paint, i16 *ch) {
+    print_pause(disp->win[WIN_FIELD], disp->block_size);
 
     timeout(-1); // wait indefinitely for input
     do {
@@ -118,12 +137,14 @@ bool pause_game(WINDOW *w_field, Game *game, i16 *ch) {
     } while(*ch != CH_PAUSE); 
 
     // Redraw field for a second
-    werase(w_field);
-    field_draw(w_field, game->block_size, game);
-    tm_draw_ghost(w_field, game->block_size, game, &game->tm_field);
-    tm_draw(w_field, game->block_size, &game->tm_field, false);
-    border_draw(w_field, WINT_FIELD_PAUSED);
+    werase(disp->win[WIN_FIELD]);
+    field_draw(disp->win[WIN_FIELD], disp->block_size, paint);
+    tm_draw_ghost(disp->win[WIN_FIELD], disp->block_size, game, &game->tm_field);
+    tm_draw(disp->win[WIN_FIELD], disp->block_size, &game->tm_field, false);
+    border_draw(disp->win[WIN_FIELD], WINT_FIELD_PAUSED);
+    wnoutrefresh(disp->win[WIN_FIELD]);
     doupdate();
+    disp->drawn = false; // the pause screen covered the windows
 
     timeout(0); // don't wait for input
     sleep(SECONDS_AFTER_PAUSE);
@@ -136,46 +157,214 @@ bool pause_game(WINDOW *w_field, Game *game, i16 *ch) {
     return true;
 }
 
-// Draws the game to the stdscr
-void draw_game(WINDOW *win[WINDOW_NUM], Game *game, u8 *blink_frame) {
+// Puts a tetromino onto the visible part of a frame
+static void frame_put(Frame *frame, Tetromino *tm, u8 cell) {
+    const Vec *block = TM_SHAPE[tm->type][tm->orientation].block;
+    for (u8 i = 0; i < TM_SIZE; i++) {
+        i16 y = tm->pos.y + block[i].y - FIELD_UM;
+        if (y >= 0)
+            frame->cell[y][tm->pos.x + block[i].x] = cell;
+    }
+}
+
+// Composes the frame that should be on the screen
+static void frame_compose(Frame *frame, Game *game, const Paint *paint, bool show_tm) {
+    memcpy(frame->cell, paint->color[FIELD_UM], sizeof(frame->cell));
+
+    if (show_tm && game->tm_field.type != BLACK) {
+        Tetromino ghost = tm_ghost(game, &game->tm_field);
+        frame_put(frame, &ghost, ghost.type | CELL_GHOST);
+        frame_put(frame, &game->tm_field, game->tm_field.type);
+    }
+
+    frame->hold_type = game->tm_hold.type;
+    frame->hold_orientation = game->tm_hold.orientation;
+    frame->next_type = game->tm_next.type;
+    frame->next_orientation = game->tm_next.orientation;
+    frame->score = game->score;
+    frame->level = game->level;
+}
+
+// Clears the windows and marks the screen as showing an empty frame
+static void display_reset(Display *disp) {
+    for (u8 w = 0; w < WIN_DEBUG; w++)
+        werase(disp->win[w]);
+
+    border_draw(disp->win[WIN_FIELD], WINT_FIELD);
+    border_draw(disp->win[WIN_HOLDTM], WINT_HOLDTM);
+    border_draw(disp->win[WIN_NEXTTM], WINT_NEXTTM);
+    border_draw(disp->win[WIN_SCORE], WINT_SCORE);
+    border_draw(disp->win[WIN_LEVEL], WINT_LEVEL);
+
+    memset(disp->shown.cell, BLACK, sizeof(disp->shown.cell));
+    disp->shown.hold_type = BLACK;
+    disp->shown.next_type = BLACK;
+    disp->shown.score = UINT32_MAX;
+    disp->shown.level = UINT8_MAX;
+    disp->drawn = true;
+
+    if (disp->debug) {
+        werase(disp->win[WIN_DEBUG]);
+        border_draw(disp->win[WIN_DEBUG], WINT_DEBUG);
+        disp->debug_frame = 0;
+    }
+}
+
+// Prints the metrics of the debug overlay
+static void debug_draw(Display *disp) {
+    WINDOW *w_debug = disp->win[WIN_DEBUG];
+    DebugStats *stats = &disp->stats;
+    struct { char *name; Rolling *roll; f64 unit; } rows[] = {
+        { "tick us", &stats->tick, 1.0e3 },
+        { "draw us", &stats->draw, 1.0e3 },
+        { "updt us", &stats->update, 1.0e3 },
+        { "slck us", &stats->slack, 1.0e3 },
+        { "bytes", &stats->bytes, 1.0 },
+    };
+
+    mvwprintw(w_debug, BORDER_THICKNESS, BORDER_THICKNESS, "%-8s%8s%8s", "", "avg", "max");
+    for (u8 i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+        mvwprintw(w_debug, BORDER_THICKNESS + 1 + i, BORDER_THICKNESS, "%-8s%8.1f%8.1f", rows[i].name,
+                  roll_avg(rows[i].roll) / rows[i].unit, roll_max(rows[i].roll) / rows[i].unit);
+    mvwprintw(w_debug, BORDER_THICKNESS + 6, BORDER_THICKNESS, "%-8s%16" PRIu64, "missed", stats->missed);
+}
+
+// Shows or hides the debug overlay, if there is room for it
+void toggle_debug(Display *disp) {
+    if (disp->win[WIN_DEBUG] == NULL)
+        return;
+
+    if (disp->debug) {
+        werase(disp->win[WIN_DEBUG]);
+        wnoutrefresh(disp->win[WIN_DEBUG]);
+        doupdate();
+    }
+
+    disp->debug = !disp->debug;
+    disp->stats = (DebugStats) { .written = bytes_written() };
+    disp->drawn = false;
+}
+
+// Redraws a Next or Hold window if its tetromino changed, returns whether it did
+static bool nh_update(Display *disp, u8 w, char *title, Tetromino *tm, u8 *type, u8 *orientation) {
+    if (tm->type == *type && (tm->type == BLACK || tm->orientation == *orientation))
+        return false;
+
+    werase(disp->win[w]);
+    tm_nh_draw(disp->win[w], disp->block_size, tm);
+    border_draw(disp->win[w], title);
+    *type = tm->type;
+    *orientation = tm->orientation;
+    return true;
+}
+
+// Draws the game to the stdscr, repainting only what changed since the last frame;
+// returns whether anything was sent to the terminal
+bool draw_game(Display *disp, Game *game, const Paint *paint) {
+    Frame frame;
+    bool show_tm = true;
+    u8 touched = 0; // windows to flush to the virtual screen
+    u64 start = disp->debug ? now_ns() : 0, update;
+
     // Don't draw anything when new tetromino is set to enter
-    if (game->entry_delay == 0 || game->entry_delay == ENTRY_DELAY) {
-        // Clearing the windows 
-        // (besides the score and level, which don't have to ever be redrawn)
-        for (u8 w = 0; w < WINDOW_NUM - 2; w++)
-            werase(win[w]);
-
-        // Drawing
-        field_draw(win[WIN_FIELD], game->block_size, game);
-        tm_nh_draw(win[WIN_HOLDTM], game->block_size, &game->tm_hold);
-        tm_nh_draw(win[WIN_NEXTTM], game->block_size, &game->tm_next);
-        print_score(win[WIN_SCORE], game->score);
-        print_level(win[WIN_LEVEL], game->level);
-
-        if (!game->on_floor) {
-            tm_draw_ghost(win[WIN_FIELD], game->block_size, game, &game->tm_field);
-            tm_draw(win[WIN_FIELD], game->block_size, &game->tm_field, false);
-            *blink_frame = UINT8_MAX;
-        } else { // Blink when on the floor
-            if (*blink_frame == UINT8_MAX) // just landed
-                *blink_frame = BLINK_FRAMES;
-            if (*blink_frame == 0)
-                *blink_frame = BLINK_INTERVAL;
-            if (*blink_frame <= BLINK_FRAMES) {
-                tm_draw_ghost(win[WIN_FIELD], game->block_size, game, &game->tm_field);
-                tm_draw(win[WIN_FIELD], game->block_size, &game->tm_field, false);
-            }
-
-            *blink_frame = *blink_frame - 1;
-        }
-
-        // Borders
-        border_draw(win[WIN_FIELD], WINT_FIELD);
-        border_draw(win[WIN_HOLDTM], WINT_HOLDTM);
-        border_draw(win[WIN_NEXTTM], WINT_NEXTTM);
-        border_draw(win[WIN_SCORE], WINT_SCORE);
-        border_draw(win[WIN_LEVEL], WINT_LEVEL);
+    if (game->entry_delay != 0 && game->entry_delay != ENTRY_DELAY)
+        return false;
+
+    if (!game->on_floor) {
+        disp->blink_frame = UINT8_MAX;
+    } else { // Blink when on the floor
+        if (disp->blink_frame == UINT8_MAX) // just landed
+            disp->blink_frame = BLINK_FRAMES;
+        if (disp->blink_frame == 0)
+            disp->blink_frame = BLINK_INTERVAL;
+        show_tm = disp->blink_frame <= BLINK_FRAMES;
+        disp->blink_frame--;
+    }
+
+    frame_compose(&frame, game, paint, show_tm);
+    if (!disp->drawn) {
+        display_reset(disp);
+        touched = (1 << WIN_DEBUG) - 1; // all of the game windows
+    }
+
+    // Field rows
+    for (u8 y = 0; y < FIELD_Y - FIELD_UM; y++) {
+        if (memcmp(frame.cell[y], disp->shown.cell[y], FIELD_X) == 0)
+            continue;
+        row_draw(disp->win[WIN_FIELD], disp->block_size, y, frame.cell[y]);
+        memcpy(disp->shown.cell[y], frame.cell[y], FIELD_X);
+        touched |= 1 << WIN_FIELD;
     }
 
+    // Next, hold, score and level
+    if (nh_update(disp, WIN_HOLDTM, WINT_HOLDTM, &game->tm_hold,
+                  &disp->shown.hold_type, &disp->shown.hold_orientation))
+        touched |= 1 << WIN_HOLDTM;
+    if (nh_update(disp, WIN_NEXTTM, WINT_NEXTTM, &game->tm_next,
+                  &disp->shown.next_type, &disp->shown.next_orientation))
+        touched |= 1 << WIN_NEXTTM;
+    if (frame.score != disp->shown.score) {
+        print_score(disp->win[WIN_SCORE], frame.score);
+        disp->shown.score = frame.score;
+        touched |= 1 << WIN_SCORE;
+    }
+    if (frame.level != disp->shown.level) {
+        print_level(disp->win[WIN_LEVEL], frame.level);
+        disp->shown.level = frame.level;
+        touched |= 1 << WIN_LEVEL;
+    }
+
+    // Debug overlay, a few times per second to stay readable
+    if (disp->debug && disp->debug_frame-- == 0) {
+        debug_draw(disp);
+        disp->debug_frame = DEBUG_INTERVAL;
+        touched |= 1 << WIN_DEBUG;
+    }
+
+    // Nothing to send to the terminal
+    if (touched == 0) {
+        if (disp->debug)
+            roll_add(&disp->stats.draw, now_ns() - start);
+        return false;
+    }
+
+    for (u8 w = 0; w < WINDOW_NUM; w++)
+        if (touched & (1 << w))
+            wnoutrefresh(disp->win[w]);
+
+    if (!disp->debug) {
+        doupdate();
+        return true;
+    }
+
+    update = now_ns();
     doupdate();
+    roll_add(&disp->stats.draw, update - start);
+    roll_add(&disp->stats.update, now_ns() - update);
+    return true;
+}
+
+// Creates the windows of a game in a slot of the ones side by side,
+// scaled if there is enough space for all of them
+void init_display(Display *disp, u8 slot, u8 slots) {
+    Windim scrdim = get_scrdim();
+    Vec block_size = { 2, 4 };
+    u16 x;
+
+    if (scrdim.cols < slots * SLOT_WIDTH - HPADDING || scrdim.rows < 42)
+        block_size = (Vec) { 1, 2 };
+    x = slot * SLOT_WIDTH;
+
+    disp->win[WIN_FIELD]  = create_win(WINLOC_FIELD_Y, x + WINLOC_FIELD_X, WINDIM_FIELD_Y, WINDIM_FIELD_X);
+    disp->win[WIN_NEXTTM] = create_win(WINLOC_NEXTTM_Y, x + WINLOC_NEXTTM_X, WINDIM_NEXTTM_Y, WINDIM_NEXTTM_X);
+    disp->win[WIN_HOLDTM] = create_win(WINLOC_HOLDTM_Y, x + WINLOC_HOLDTM_X, WINDIM_HOLDTM_Y, WINDIM_HOLDTM_X);
+    disp->win[WIN_SCORE]  = create_win(WINLOC_SCORE_Y, x + WINLOC_SCORE_X, WINDIM_SCORE_Y, WINDIM_SCORE_X);
+    disp->win[WIN_LEVEL]  = create_win(WINLOC_LEVEL_Y, x + WINLOC_LEVEL_X, WINDIM_LEVEL_Y, WINDIM_LEVEL_X);
+    disp->win[WIN_DEBUG]  = slot == 0 ? create_win(WINLOC_DEBUG_Y, slots * SLOT_WIDTH, WINDIM_DEBUG_Y, WINDIM_DEBUG_X)
+                                      : NULL; // NULL without room
+
+    disp->block_size = block_size;
+    disp->blink_frame = UINT8_MAX;
+    disp->drawn = false;
+    disp->debug = false;
 }
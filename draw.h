@@ -1,8 +1,10 @@
 #pragma once
 
+#include "utils.h"
 #include "game.h"
+#include "stats.h"
 
-#define WINDOW_NUM 5
+#define WINDOW_NUM 6
 #define MAX_TITLE_LEN 32
 #define PAUSE_CHAR '/'
 
@@ -12,20 +14,59 @@
 #define WINT_NEXTTM "NEXT"
 #define WINT_LEVEL "LEVEL"
 #define WINT_SCORE "SCORE"
+#define WINT_DEBUG "DEBUG"
 
 #define DRAW_CHAR ' ' | A_REVERSE
 #define GHOST_CHAR ACS_BOARD
+#define GARBAGE_CHAR ACS_CKBOARD
 #define BLINK_INTERVAL (FRAMERATE / 6)
 #define BLINK_FRAMES (BLINK_INTERVAL / 2 + 1)
 
 #define SECONDS_AFTER_PAUSE 1 
+#define DEBUG_INTERVAL (FRAMERATE / 4) // frames between redraws of the debug overlay
+
+#define MAX_BLOCK_X 4   // widest block, in characters
+#define CELL_GHOST 0x10 // flags a field cell as a part of the ghost tetromino
+
+// What is shown on the screen, compared against the game to draw only changes
+typedef struct Frame {
+    u8 cell[FIELD_Y - FIELD_UM][FIELD_X]; // colors, BLACK when empty
+    u8 hold_type, hold_orientation;
+    u8 next_type, next_orientation;
+    u32 score;
+    u8 level;
+} Frame;
+
+// Live metrics shown in the debug overlay, collected only while it is shown
+typedef struct DebugStats {
+    Rolling tick;    // ns spent in tick()
+    Rolling draw;    // ns spent in draw_game() before doupdate()
+    Rolling update;  // ns spent in doupdate()
+    Rolling slack;   // ns left until the next frame
+    Rolling bytes;   // bytes written per frame
+    u64 written;     // bytes written until the last frame
+    u64 missed;      // frames started late or skipped
+} DebugStats;
+
+typedef struct Display {
+    WINDOW *win[WINDOW_NUM];
+    Vec block_size;
+    u8 blink_frame;
+    bool drawn;  // whether the shown frame is on the screen, else redraw it all
+    Frame shown;
+    bool debug;  // the debug overlay is shown
+    u8 debug_frame;
+    DebugStats stats;
+} Display;
 
 void tm_draw(WINDOW *win, Vec block_size, Tetromino *tm, bool ghost);
 void tm_nh_draw(WINDOW *win, Vec block_size, Tetromino *tm);
 void tm_draw_ghost(WINDOW *win, Vec block_size, Game *game, Tetromino *tm);
-void field_draw(WINDOW *w_field, Vec block_size, Game *game);
+void field_draw(WINDOW *w_field, Vec block_size, const Paint *paint);
 void print_score(WINDOW *w_score, u32 score);
 void print_level(WINDOW *w_level, u8 level);
-void print_pause(WINDOW *win, Game *game);
-bool pause_game(WINDOW *w_field, Game *game, i16 *ch);
-void draw_game(WINDOW *win[WINDOW_NUM], Game *game, u8 *blink_frame);
+void print_pause(WINDOW *win, Vec block_size);
+bool pause_game(Display *disp, Game *game, const Paint *paint, i16 *ch);
+bool draw_game(Display *disp, Game *game, const Paint *paint);
+void toggle_debug(Display *disp);
+void init_display(Display *disp, u8 slot, u8 slots);
@@ -1,53 +1,11 @@
 #include <stdbool.h>
-#include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
 #include "game.h"
+#include "tm_table.h"
 
-// All tetromino variants saved as arrays of blocks
-const Vec TM_BLOCKS[TM_NUM][TM_ORIENT][TM_SIZE] = { // relative (y, x) coordinates
-    { // O 
-        { {0, 0}, {0, 1}, {1, 0}, {1, 1} }, 
-        { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
-        { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
-        { {0, 0}, {0, 1}, {1, 0}, {1, 1} }
-    },
-    { // Z
-        { {1, 2}, {1, 1}, {0, 1}, {0, 0} },
-        { {2, 1}, {1, 1}, {1, 2}, {0, 2} },
-        { {1, 0}, {1, 1}, {2, 1}, {2, 2} },
-        { {0, 1}, {1, 1}, {1, 0}, {2, 0} }
-    },
-    { // S 
-        { {1, 0}, {1, 1}, {0, 1}, {0, 2} },
-        { {0, 1}, {1, 1}, {1, 2}, {2, 2} },
-        { {1, 2}, {1, 1}, {2, 1}, {2, 0} },
-        { {2, 1}, {1, 1}, {1, 0}, {0, 0} }
-    },
-    { // L
-        { {1, 0}, {1, 1}, {1, 2}, {0, 2} },
-        { {0, 1}, {1, 1}, {2, 1}, {2, 2} },
-        { {1, 0}, {1, 1}, {1, 2}, {2, 0} },
-        { {0, 1}, {1, 1}, {2, 1}, {0, 0} },
-    },
-    { // J 
-        { {1, 0}, {1, 1}, {1, 2}, {0, 0} },
-        { {0, 1}, {1, 1}, {2, 1}, {0, 2} },
-        { {1, 0}, {1, 1}, {1, 2}, {2, 2} },
-        { {0, 1}, {1, 1}, {2, 1}, {2, 0} },
-    },
-    { // T
-        { {1, 0}, {1, 1}, {1, 2}, {0, 1} },
-        { {0, 1}, {1, 1}, {2, 1}, {1, 2} },
-        { {1, 0}, {1, 1}, {1, 2}, {2, 1} },
-        { {0, 1}, {1, 1}, {2, 1}, {1, 0} },
-    }, 
-    { // I
-        { {1, 0}, {1, 1}, {1, 2}, {1, 3} },
-        { {0, 2}, {1, 2}, {2, 2}, {3, 2} },
-        { {2, 0}, {2, 1}, {2, 2}, {2, 3} },
-        { {0, 1}, {1, 1}, {2, 1}, {3, 1} },
-    }, 
-};
+// PCG32 multiplier and stream increment
+#define PCG_MULT 6364136223846793005ULL
+#define PCG_INC 1442695040888963407ULL
 
 // Gravity level depending on game level (for 60FPS)
 const u8 GRAVITY[GRAVITY_ARR_SIZE] = {
@@ -90,65 +48,29 @@ const Vec WALL_KICK_I[TM_ROT_DIRS][TM_ORIENT][WK_TESTS] = {
 };
 
 // Returns a correct gravity value for a level
-inline static u8 gravity(u8 level) {
+u8 gravity(u8 level) {
     return (u8) ((level <= GRAVITY_ARR_SIZE ? GRAVITY[level-1] : 2) * (FRAMERATE / (60.0)));
 }
 
-// Calculates the bounding box for tetrominoes
-static BoundingBox calc_bbox(Tetromino *tm) {
-    BoundingBox bbox =  { 
-        .top = TM_SIZE - 1,
-        .left = TM_SIZE - 1,
-        .right = 0,
-        .bottom = 0
-    };
-
-    for (u8 i = 0; i < TM_SIZE; i++) {
-        if (tm->block[i].x < bbox.left)
-            bbox.left = tm->block[i].x;
-        if (tm->block[i].x > bbox.right)
-            bbox.right = tm->block[i].x;
-        if (tm->block[i].y < bbox.top)
-            bbox.top = tm->block[i].y;
-        if (tm->block[i].y > bbox.bottom)
-            bbox.bottom = tm->block[i].y;
-    }
-
-    return bbox;
-}
-
-// Calculates the correct origin for drawing tetrominos in Hold and Next windows
-static Vec calc_nh_pos(Vec block_size, Tetromino *tm) {
-    Vec nh_pos = { BORDER_THICKNESS, BORDER_THICKNESS };
-    u8 margin_h, margin_v;
-
-    // Calculating the margin size in drawing coordinates
-    margin_h = (TM_SIZE - (tm->bbox.right - tm->bbox.left + 1)) * block_size.x / 2;
-    margin_v = (TM_SIZE - (tm->bbox.bottom - tm->bbox.top + 1)) * block_size.y / 2;
-
-    nh_pos.x += margin_h - tm->bbox.left * block_size.x;
-    nh_pos.y += margin_v - tm->bbox.top * block_size.y;
-
-    return nh_pos;
+// Centers a tetromino
+inline static void tm_center(Tetromino *tm) {
+    tm->pos.x = TM_SHAPE[tm->type][tm->orientation].spawn_x;
 }
 
-// Inserts data into a tetromino struct
-static void tm_insert_data(Vec block_size, Tetromino *tm, Vec pos, Tm_Type type, u8 orientation) {
-    tm->type = type;
-    tm->orientation = orientation;
-    tm->pos = (Vec) { pos.y, pos.x };
+// Advances the PCG32 (XSH RR) generator of a game
+static u32 rng_next(Game *game) {
+    u64 state = game->rng;
+    u32 xorshifted, rot;
 
-    for (u8 i = 0; i < TM_SIZE; i++) {
-        tm->block[i] = TM_BLOCKS[tm->type][tm->orientation][i];
-    }
-
-    tm->bbox = calc_bbox(tm);
-    tm->pos_nh = calc_nh_pos(block_size, tm);
+    game->rng = state * PCG_MULT + PCG_INC;
+    xorshifted = ((state >> 18) ^ state) >> 27;
+    rot = state >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
 }
 
-// Centers a tetromino
-inline static void tm_center(Tetromino *tm) {
-    tm->pos.x = (FIELD_X - (tm->bbox.right - tm->bbox.left + 1)) / 2 - tm->bbox.left;
+// Returns a random number from 0 to bound - 1
+inline static u32 rng_bounded(Game *game, u32 bound) {
+    return ((u64) rng_next(game) * bound) >> 32;
 }
 
 // Shuffles a randomizer bag using Fisher-Yates shuffle
@@ -156,7 +78,7 @@ static void shuffle_bag(Game *game) {
     u8 i, j;
     Tm_Type tmp;
     for (i = 1; i < BAG_SIZE; i++) {
-        j = rand() % (i + 1);
+        j = rng_bounded(game, i + 1);
         tmp = game->bag[i];
         game->bag[i] = game->bag[j];
         game->bag[j] = tmp;
@@ -171,54 +93,82 @@ static Tm_Type tm_rand(Game *game) {
         shuffle_bag(game);
 
     val = game->bag[game->bag_index];
+    game->hash ^= ZOBRIST_BAG[game->bag_index];
     game->bag_index = (game->bag_index + 1) % BAG_SIZE;
+    game->hash ^= ZOBRIST_BAG[game->bag_index];
     return val;
 }
 
 // Generates a random tetromino
 Tetromino tm_create_rand(Game *game) {
-    Tetromino tm;
-    tm_insert_data(game->block_size, &tm, (Vec) { 0, 0 }, tm_rand(game), 0);
+    Tetromino tm = { .type = tm_rand(game), .orientation = 0, .pos = { 0, 0 } };
     tm_center(&tm);
     return tm;
 }
 
 // Returns a rotated tetromino without any checks
-static Tetromino tm_rotated(Game *game, Tetromino *tm, bool clockwise) {
-    Tetromino tm_r;
-    u8 orientation = (tm->orientation + (clockwise ? 1 : TM_ORIENT - 1)) % TM_ORIENT;
-    tm_insert_data(game->block_size, &tm_r, tm->pos, tm->type, orientation);
+static Tetromino tm_rotated(Tetromino *tm, bool clockwise) {
+    Tetromino tm_r = *tm;
+    tm_r.orientation = (tm->orientation + (clockwise ? 1 : TM_ORIENT - 1)) % TM_ORIENT;
     return tm_r; 
 }
 
 // Checks whether a tetromino fits in a given position
 bool tm_fits(Game *game, Tetromino *tm, Vec offset) {
-    Vec moved_block_pos;
-
-    if (tm->pos.x + offset.x + tm->bbox.left < 0 ||
-        tm->pos.y + offset.y + tm->bbox.top < 0 ||
-        tm->pos.x + offset.x + tm->bbox.right >= FIELD_X ||
-        tm->pos.y + offset.y + tm->bbox.bottom >= FIELD_Y )
+    if (tm->type == BLACK)
         return false;
 
-    for (u8 i = 0; i < TM_SIZE; i++) {
-        moved_block_pos.x = tm->block[i].x + tm->pos.x + offset.x;
-        moved_block_pos.y = tm->block[i].y + tm->pos.y + offset.y;
+    const BoundingBox *bbox = &TM_SHAPE[tm->type][tm->orientation].bbox;
+    const u16 *mask;
+    Vec pos = { tm->pos.y + offset.y, tm->pos.x + offset.x };
+
+    if (pos.x + bbox->left < 0 ||
+        pos.y + bbox->top < 0 ||
+        pos.x + bbox->right >= FIELD_X ||
+        pos.y + bbox->bottom >= FIELD_Y )
+        return false;
 
-        if (game->field[moved_block_pos.y][moved_block_pos.x] != BLACK)
+    mask = TM_MASK[tm->type][tm->orientation][TM_COL(pos.x)];
+    for (u8 y = bbox->top; y <= bbox->bottom; y++)
+        if (game->board[pos.y + y] & mask[y])
             return false;
-    }
 
     return true;
 }
 
+// Number of rows a tetromino can fall before it lands,
+// from the first taken cell under the lowest block of each of its columns
+u8 tm_drop_distance(Game *game, Tetromino *tm) {
+    const TmShape *shape;
+    u8 distance = FIELD_Y;
+    i16 y, landing;
+    u32 below;
+
+    if (tm->type == BLACK)
+        return 0;
+
+    shape = &TM_SHAPE[tm->type][tm->orientation];
+    for (u8 c = shape->bbox.left; c <= shape->bbox.right; c++) {
+        y = tm->pos.y + shape->floor[c];
+        below = game->column[tm->pos.x + c];
+        if (y >= 0)
+            below &= ~((2u << y) - 1);
+        landing = below != 0 ? __builtin_ctz(below) : FIELD_Y;
+        if (landing - y - 1 < distance)
+            distance = landing - y - 1;
+    }
+
+    return distance;
+}
+
 // Checks if the falling tetromino is on the floor
 bool tm_on_floor(Game *game, Tetromino *tm) {
-    return !tm_fits(game, tm, (Vec) { 1, 0 });
+    return tm_drop_distance(game, tm) == 0;
 }
 
 // Spawns a next tetromino onto the field
 bool tm_spawn(Game *game) {
+    game->hash ^= ZOBRIST_PIECE[game->tm_field.type] ^ ZOBRIST_PIECE[game->tm_next.type];
     game->tm_field = game->tm_next;
     game->tm_next = tm_create_rand(game);
     game->gravity_timer = 0;
@@ -263,14 +213,33 @@ static bool tm_mv(Game *game, Tetromino *tm, Direction dir) {
 
 // Sets a tetromino onto the field
 static void tm_lock(Game *game) {
+    Tetromino *tm = &game->tm_field;
+    const TmShape *shape;
+    const u16 *mask;
     Vec block_pos;
+
+    if (tm->type == BLACK)
+        return;
+
+    shape = &TM_SHAPE[tm->type][tm->orientation];
+    mask = TM_MASK[tm->type][tm->orientation][TM_COL(tm->pos.x)];
+    for (u8 y = shape->bbox.top; y <= shape->bbox.bottom; y++)
+        game->board[tm->pos.y + y] |= mask[y];
+
     for (u8 i = 0; i < TM_SIZE; i++) {
         block_pos = (Vec) { 
-            .x = game->tm_field.pos.x + game->tm_field.block[i].x,
-            .y = game->tm_field.pos.y + game->tm_field.block[i].y
+            .x = tm->pos.x + shape->block[i].x,
+            .y = tm->pos.y + shape->block[i].y
         };
-        game->field[block_pos.y][block_pos.x] = game->tm_field.type;
+        game->column[block_pos.x] |= 1u << block_pos.y;
+        game->hash ^= ZOBRIST_CELL[block_pos.y][block_pos.x];
     }
+    game->hash ^= ZOBRIST_PIECE[tm->type] ^ ZOBRIST_PIECE[BLACK];
+    game->tm_locked = *tm;
+
+    // only the rows of the piece could have been filled
+    clear_lines(game, tm->pos.y + shape->bbox.top, tm->pos.y + shape->bbox.bottom);
+
     game->entry_delay = ENTRY_DELAY;
     game->tm_field.type = BLACK;
 }
@@ -307,8 +276,10 @@ static void tm_hold(Game *game) {
         return;
 
     Tetromino tm_tmp; 
+    u8 hold_type = game->tm_hold.type;
+    Tetromino *tm_in = game->tm_hold.type != BLACK ? &game->tm_hold : &game->tm_next;
 
-    if (!tm_fits(game, &game->tm_hold, (Vec) { 0, 0 }))
+    if (!tm_fits(game, tm_in, (Vec) { 0, 0 }))
         return;
 
     // not holding a tetromino
@@ -323,6 +294,8 @@ static void tm_hold(Game *game) {
 
     game->tm_hold.pos.y = 0;
     tm_center(&game->tm_hold);
+    game->hash ^= ZOBRIST_PIECE[tm_tmp.type] ^ ZOBRIST_PIECE[game->tm_field.type];
+    game->hash ^= ZOBRIST_HOLD[hold_type] ^ ZOBRIST_HOLD[game->tm_hold.type];
     game->on_floor = tm_on_floor(game, &game->tm_field);
     game->swapped = true;
 }
@@ -346,14 +319,15 @@ static bool wall_kick(Game *game, Tetromino *tm, bool clockwise) {
 }
 
 // Rotates the field tetromino clockwise
-static void tm_rotate(Game *game, bool clockwise) {
-    tm_handle_ldd(game);
+void tm_rotate(Game *game, bool clockwise) {
+    if (!tm_handle_ldd(game))
+        return;
     if (game->tm_field.type == TM_O) {
         game->tm_field.orientation = (game->tm_field.orientation + 1) % TM_ORIENT;
         return;
     }
 
-    Tetromino tm_tmp = tm_rotated(game, &game->tm_field, clockwise);
+    Tetromino tm_tmp = tm_rotated(&game->tm_field, clockwise);
     if (tm_fits(game, &tm_tmp, (Vec) { 0, 0 })) {
         game->tm_field = tm_tmp;
         game->on_floor = tm_on_floor(game, &game->tm_field);
@@ -364,21 +338,8 @@ static void tm_rotate(Game *game, bool clockwise) {
 }
 
 // Checks if a line on a field is full
-static bool is_line_full(Game *game, u8 line) {
-    for (u8 x = 0; x < FIELD_X; x++)
-        if (game->field[line][x] == BLACK)
-            return false;
-    return true;
-}
-
-// Removes a line by moving all of the lines above one block down
-static void remove_line(Game *game, u8 removed_line) {
-    for (u8 y = removed_line; y > 0; y--)
-        for (u8 x = 0; x < FIELD_X; x++)
-            game->field[y][x] = game->field[y-1][x];
-
-    for (u8 x = 0; x < FIELD_X; x++)
-        game->field[0][x] = BLACK;
+inline static bool is_line_full(Game *game, u8 line) {
+    return game->board[line] == FIELD_ROW_FULL;
 }
 
 // Awards points based on how many lines were cleared
@@ -387,7 +348,7 @@ static void award_points(Game *game, u8 lines_cleared) {
 
     // Lowest line being empty means that the whole field is
     // empty - perfect clear
-    if (!is_line_full(game, FIELD_Y - 1)) {
+    if (game->board[FIELD_Y - 1] != 0) {
         switch (lines_cleared) {
             case 1: multiplier = 100; break;
             case 2: multiplier = 300; break;
@@ -408,41 +369,121 @@ static void award_points(Game *game, u8 lines_cleared) {
         game->score += 50 * game->combo * game->level;
 }
 
-// Clears all full lines and awards points
-static void clear_lines(Game *game) {
+// Zobrist key of the taken cells of a row
+inline static u64 row_hash(u8 y, u16 row) {
+    return ZOBRIST_ROW[y][0][row & ((1 << ZOBRIST_HALF) - 1)] ^ ZOBRIST_ROW[y][1][row >> ZOBRIST_HALF];
+}
+
+// Clears the full lines between the top and bottom rows and awards points;
+// the rows above move down in a single pass, each of them once
+void clear_lines(Game *game, u8 top, u8 bottom) {
     u8 lines_cleared = 0;
+    u32 full = 0;
+    i16 dst = bottom;
 
-    for (u8 line = 0; line < FIELD_Y; line++) {
+    for (u8 line = top; line <= bottom; line++) {
         if (is_line_full(game, line)) {
             lines_cleared++;
-            remove_line(game, line);
-            if (lines_cleared == 4)
-                break;
+            full |= 1u << line;
         }
     }
 
+    game->cleared = full;
     if (lines_cleared == 0) {
         game->combo = -1;
         return;
     }
 
+    // every row down to the bottom one changes, so they are hashed again
+    for (u8 y = 0; y <= bottom; y++)
+        game->hash ^= row_hash(y, game->board[y]);
+    for (i16 src = bottom; src >= 0; src--) {
+        if (src >= top && is_line_full(game, src))
+            continue;
+        if (dst != src)
+            game->board[dst] = game->board[src];
+        dst--;
+    }
+    for (; dst >= 0; dst--)
+        game->board[dst] = 0;
+    for (u8 y = 0; y <= bottom; y++)
+        game->hash ^= row_hash(y, game->board[y]);
+
+    // removing the rows from the columns, from the top so that the lower ones stay put
+    for (; full != 0; full &= full - 1) {
+        u8 line = __builtin_ctz(full);
+        for (u8 x = 0; x < FIELD_X; x++)
+            game->column[x] = (game->column[x] & ~((2u << line) - 1))
+                            | ((game->column[x] & ((1u << line) - 1)) << 1);
+    }
+
     award_points(game, lines_cleared);
     game->lines_cleared += lines_cleared;
     game->level = game->lines_cleared / LINES_PER_LEVEL + 1;
 }
 
 // Drops the field tetromino to the ground and awards points
-static void hard_drop(Game *game) {
-    u8 init_y, height;
+void hard_drop(Game *game) {
+    u8 height = tm_drop_distance(game, &game->tm_field);
 
-    init_y = game->tm_field.pos.y;
-    while (tmf_mv(game, DOWN));
-    height = game->tm_field.pos.y - init_y;
+    game->tm_field.pos.y += height;
     game->score += 2 * height;
+    if (height > 0)
+        game->on_floor = true;
+}
+
+// Raises the board by rows taken but for a hole column, from the bottom;
+// returns false when taken cells were pushed out of the top
+bool add_garbage(Game *game, u8 lines, u8 hole) {
+    u16 row = FIELD_ROW_FULL & ~(1 << hole);
+    u32 rows;
+    bool fits = true;
+
+    if (lines > FIELD_Y)
+        lines = FIELD_Y;
+    rows = ((1u << lines) - 1) << (FIELD_Y - lines);
+
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        fits &= y >= lines || game->board[y] == 0;
+        game->hash ^= row_hash(y, game->board[y]);
+    }
+    memmove(game->board, game->board + lines, (FIELD_Y - lines) * sizeof(game->board[0]));
+    for (u8 y = FIELD_Y - lines; y < FIELD_Y; y++)
+        game->board[y] = row;
+    for (u8 y = 0; y < FIELD_Y; y++)
+        game->hash ^= row_hash(y, game->board[y]);
+
+    for (u8 x = 0; x < FIELD_X; x++)
+        game->column[x] = (game->column[x] >> lines) | (x != hole ? rows : 0);
+    return fits;
+}
+
+// Rebuilds the column masks and the hash after the board was written directly
+void update_columns(Game *game) {
+    for (u8 x = 0; x < FIELD_X; x++) {
+        game->column[x] = 0;
+        for (u8 y = 0; y < FIELD_Y; y++)
+            if (game->board[y] & (1 << x))
+                game->column[x] |= 1u << y;
+    }
+    game->hash = game_hash(game);
+}
+
+// Computes the Zobrist hash of a game from scratch
+u64 game_hash(Game *game) {
+    u64 hash = ZOBRIST_PIECE[game->tm_field.type] ^ ZOBRIST_HOLD[game->tm_hold.type]
+             ^ ZOBRIST_BAG[game->bag_index];
+
+    for (u8 y = 0; y < FIELD_Y; y++)
+        hash ^= row_hash(y, game->board[y]);
+    return hash;
 }
 
 // Performs the game logic in a given frame
-bool tick(Game *game, i16 ch) {
+bool tick(Game *game, u16 input) {
+    game->tm_locked.type = BLACK;
+    game->cleared = 0;
+
     // handling the entry delay
     if (game->entry_delay > 1) {
         game->entry_delay--;
@@ -450,7 +491,7 @@ bool tick(Game *game, i16 ch) {
     } else if (game->entry_delay == 1) {
         game->entry_delay--;
         if (!tm_spawn(game)) { 
-            sleep(1); 
+            game->over = true;
             return false; 
         }
     }
@@ -462,21 +503,28 @@ bool tick(Game *game, i16 ch) {
     }
 
     // input handling
-    switch (ch) {
-        case CH_MV_LEFT:    tmf_mv(game, LEFT); break; 
-        case CH_MV_RIGHT:   tmf_mv(game, RIGHT); break;
-        case CH_ROTATE_CW:  tm_rotate(game, true); break;
-        case CH_ROTATE_CCW: tm_rotate(game, false); break;
-        case CH_HOLD:       tm_hold(game); break;
-        case CH_QUIT:       return false; break;
-        case CH_HARD_DROP:  hard_drop(game); tm_lock(game); break;
-        
-        case CH_SOFT_DROP:  
-            if (tmf_mv(game, DOWN)) {
-                game->score++;
-                game->gravity_acted = true;
-                game->gravity_timer = gravity(game->level);
-            } break;
+    if (input & IN_QUIT)
+        return false;
+    if (input & IN_HOLD)
+        tm_hold(game);
+    if (input & IN_ROTATE_CW)
+        tm_rotate(game, true);
+    if (input & IN_ROTATE_CCW)
+        tm_rotate(game, false);
+    if (input & IN_MV_LEFT)
+        tmf_mv(game, LEFT);
+    if (input & IN_MV_RIGHT)
+        tmf_mv(game, RIGHT);
+    if (input & IN_SOFT_DROP) {
+        if (tmf_mv(game, DOWN)) {
+            game->score++;
+            game->gravity_acted = true;
+            game->gravity_timer = gravity(game->level);
+        }
+    }
+    if (input & IN_HARD_DROP) {
+        hard_drop(game);
+        tm_lock(game);
     }
 
     // lowering the floor timer when on the floor 
@@ -500,8 +548,82 @@ bool tick(Game *game, i16 ch) {
     }
     game->gravity_timer--;
 
-    // clearing lines
-    clear_lines(game);
-
     return true;
 }
+
+// Seeds the piece randomizer of a game
+void game_seed(Game *game, u64 seed) {
+    game->rng = 0;
+    rng_next(game);
+    game->rng += seed;
+    rng_next(game);
+}
+
+// Sets up a new game with an empty field
+void game_init(Game *game, u64 seed) {
+    *game = (Game) {
+        .score = 0,
+        .lines_cleared = 0,
+        .level = 1,
+        .combo = -1,
+        .bag = { 0, 1, 2, 3, 4, 5, 6 },
+        .bag_index = 0,
+        .on_floor = false,
+        .swapped = false,
+        .entry_delay = 0,
+        .gravity_acted = false,
+        .paused = false,
+        .over = false,
+    };
+
+    game_seed(game, seed);
+    game->tm_next = tm_create_rand(game);
+    game->tm_hold = (Tetromino) { .type = BLACK };
+    game->tm_field = (Tetromino) { .type = BLACK };
+    game->tm_locked = (Tetromino) { .type = BLACK };
+    game->hash = game_hash(game);
+    tm_spawn(game);
+}
+
+// Empties the colors of a field
+void paint_init(Paint *paint) {
+    memset(paint->color, BLACK, sizeof(paint->color));
+}
+
+// Colors the tetromino the last tick locked and removes the rows it cleared
+void paint_update(Paint *paint, const Game *game) {
+    const Tetromino *tm = &game->tm_locked;
+    const Vec *block;
+    i16 dst = FIELD_Y - 1;
+
+    if (tm->type == BLACK)
+        return;
+
+    block = TM_SHAPE[tm->type][tm->orientation].block;
+    for (u8 i = 0; i < TM_SIZE; i++)
+        paint->color[tm->pos.y + block[i].y][tm->pos.x + block[i].x] = tm->type;
+    if (game->cleared == 0)
+        return;
+
+    for (i16 src = FIELD_Y - 1; src >= 0; src--) {
+        if (game->cleared & (1u << src))
+            continue;
+        if (dst != src)
+            memcpy(paint->color[dst], paint->color[src], FIELD_X);
+        dst--;
+    }
+    for (; dst >= 0; dst--)
+        memset(paint->color[dst], BLACK, FIELD_X);
+}
+
+// Raises the colors the way add_garbage() raised the board
+void paint_garbage(Paint *paint, u8 lines, u8 hole) {
+    if (lines > FIELD_Y)
+        lines = FIELD_Y;
+
+    memmove(paint->color, paint->color[lines], (FIELD_Y - lines) * FIELD_X);
+    for (u8 y = FIELD_Y - lines; y < FIELD_Y; y++) {
+        memset(paint->color[y], GRAY, FIELD_X);
+        paint->color[y][hole] = BLACK;
+    }
+}
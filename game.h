@@ -1,7 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
-#include "utils.h"
+#include "types.h"
 
 #define FRAMERATE 60
 #define FRAMETIME ((f64) (1.0 / FRAMERATE))
@@ -21,21 +21,12 @@
 #define FIELD_UM 2
 #define FIELD_X 10
 #define FIELD_Y (20 + FIELD_UM)
+#define FIELD_ROW_FULL ((u16) ((1 << FIELD_X) - 1))
 #define BORDER_THICKNESS 1
 
 #define GRAVITY_ARR_SIZE 20
 #define LINES_PER_LEVEL 10
 
-#define CH_MV_LEFT KEY_LEFT
-#define CH_MV_RIGHT KEY_RIGHT
-#define CH_ROTATE_CW KEY_UP
-#define CH_ROTATE_CCW 'z'
-#define CH_SOFT_DROP KEY_DOWN 
-#define CH_HARD_DROP ' '
-#define CH_HOLD 'c'
-#define CH_QUIT 'q'
-#define CH_PAUSE 'p'
-
 typedef struct Vec {
     i16 y;
     i16 x;
@@ -52,33 +43,46 @@ typedef struct Tetromino {
     u8 type;
     u8 orientation;
     Vec pos;
-    Vec pos_nh;
-    Vec block[TM_SIZE];
-    BoundingBox bbox;
 } Tetromino;
 
+// State of a game as the engine sees it, 160 bytes. The tetrominoes and the
+// scalars up to the randomizer fit in the first 64 bytes, the hash, the board
+// and its column masks follow; the shapes of the tetrominoes
+// come from the tables in tm_table.c and the colors of the locked blocks,
+// which only drawing needs, are kept apart in a Paint.
 typedef struct Game {
-    u32 score;
-    u32 lines_cleared;
-    u8 level;
-    i8 combo;
-    u8 bag[BAG_SIZE];
-    u8 bag_index;
     Tetromino tm_field;
     Tetromino tm_next;
     Tetromino tm_hold;
-    bool on_floor;
-    bool swapped;
-    u8 field[FIELD_Y][FIELD_X];
+    Tetromino tm_locked;          // locked by the last tick, BLACK when none
     u8 gravity_timer;
     u8 floor_timer;
     u8 floor_counter;
     u8 entry_delay;
+    bool on_floor;
+    bool swapped;
     bool gravity_acted;
     bool paused;
-    Vec block_size;
+    bool over;
+    u8 level;
+    i8 combo;
+    u8 bag_index;
+    u8 bag[BAG_SIZE];
+    u32 cleared;                  // rows cleared by the last tick, bit y is set when row y was
+    u32 score;
+    u32 lines_cleared;
+    u64 rng;
+    u64 hash;                     // Zobrist hash of the board, the field and held types and the bag position
+    u16 board[FIELD_Y];           // occupancy, bit x is set when column x is taken
+    u32 column[FIELD_X];          // the same by columns, bit y is set when row y is taken
 } Game;
 
+// Colors of the locked blocks, for drawing; paint_update() brings them
+// up to date after every tick
+typedef struct Paint {
+    u8 color[FIELD_Y][FIELD_X];
+} Paint;
+
 typedef enum Tm_Type {
     TM_O, TM_Z, TM_S, TM_L, TM_J, TM_T, TM_I
 } Tm_Type;
@@ -87,7 +91,38 @@ typedef enum Direction {
     LEFT, RIGHT, UP, DOWN
 } Direction;
 
+// Input bits handled by a single tick
+typedef enum Input {
+    IN_NONE       = 0,
+    IN_MV_LEFT    = 1 << 0,
+    IN_MV_RIGHT   = 1 << 1,
+    IN_ROTATE_CW  = 1 << 2,
+    IN_ROTATE_CCW = 1 << 3,
+    IN_SOFT_DROP  = 1 << 4,
+    IN_HARD_DROP  = 1 << 5,
+    IN_HOLD       = 1 << 6,
+    IN_QUIT       = 1 << 7
+} Input;
+
+// Wall kick offsets tested by a rotation, by direction and resulting orientation
+extern const Vec WALL_KICK[TM_ROT_DIRS][TM_ORIENT][WK_TESTS];
+extern const Vec WALL_KICK_I[TM_ROT_DIRS][TM_ORIENT][WK_TESTS];
+
+void game_seed(Game *game, u64 seed);
+void game_init(Game *game, u64 seed);
 Tetromino tm_create_rand(Game *game);
 bool tm_fits(Game *game, Tetromino *tm, Vec offset);
+u8 tm_drop_distance(Game *game, Tetromino *tm);
+bool tm_on_floor(Game *game, Tetromino *tm);
 bool tm_spawn(Game *game);
-bool tick(Game *game, i16 ch);
+void tm_rotate(Game *game, bool clockwise);
+void hard_drop(Game *game);
+void clear_lines(Game *game, u8 top, u8 bottom);
+bool add_garbage(Game *game, u8 lines, u8 hole);
+void update_columns(Game *game);
+u64 game_hash(Game *game);
+u8 gravity(u8 level);
+bool tick(Game *game, u16 input);
+void paint_init(Paint *paint);
+void paint_update(Paint *paint, const Game *game);
+void paint_garbage(Paint *paint, u8 lines, u8 hole);
@@ -0,0 +1,175 @@
+#include <curses.h>
+#include <stdint.h>
+#include <string.h>
+#include "input.h"
+#include "utils.h"
+#include "game.h"
+
+// Delayed auto shift and auto repeat rate, indexed by the bit of an IN_ value;
+// only moving left, right and soft dropping repeat
+static const u16 KB_DAS[KB_KEYS] = { DAS_FRAMES, DAS_FRAMES, 0, 0, 0, 0, 0, 0 };
+static const u16 KB_ARR[KB_KEYS] = { ARR_FRAMES, ARR_FRAMES, 0, 0, 1, 0, 0, 0 };
+
+// Position of every input bit in the order tick() applies them
+static const u8 KB_ORDER[KB_KEYS] = { 4, 5, 2, 3, 6, 7, 1, 0 };
+
+// Kinds of key events
+typedef enum KeyKind {
+    KEY_PRESS, KEY_REPEAT, KEY_UNSURE // unsure: a press or the first repeat
+} KeyKind;
+
+void kb_init(Keyboard *kb) {
+    *kb = (Keyboard) { .last_bit = KB_KEYS, .unsure = KB_KEYS };
+}
+
+// Queues every key waiting in the terminal
+void kb_read(Keyboard *kb, u64 now) {
+    i16 ch;
+
+    while ((ch = getch()) != ERR)
+        if (kb->queued < KB_QUEUE_SIZE)
+            kb->queue[kb->queued++] = (KeyEvent) { ch, now };
+}
+
+// Whether a time is within the jitter of the expected one
+static bool kb_near(u64 time, u64 expected) {
+    u64 diff = time > expected ? time - expected : expected - time;
+    return diff <= KB_CADENCE_SLACK_NS + expected / 8;
+}
+
+// Tells what an event of an input, gap after the previous one, is. Pressing
+// another key stops the terminal repeating this one. Until the repeat cadence
+// is known, a run of three evenly spaced events after the delay establishes
+// it and only its last event counts as a repeat.
+static KeyKind kb_kind(Keyboard *kb, u8 bit, u64 gap) {
+    u64 prev = kb->gap[bit][0], delay = kb->gap[bit][1];
+
+    if (kb->last_bit != bit)
+        return KEY_PRESS;
+    if (kb->repeat_rate != 0) {
+        if (kb->repeat[bit])
+            return kb_near(gap, kb->repeat_rate) ? KEY_REPEAT : KEY_PRESS;
+        return kb_near(gap, kb->repeat_delay) ? KEY_UNSURE : KEY_PRESS;
+    }
+
+    if (gap > KB_REPEAT_GAP_NS || prev > KB_REPEAT_GAP_NS || !kb_near(gap, prev)
+        || delay <= KB_REPEAT_GAP_NS || delay > KB_REPEAT_DELAY_NS)
+        return KEY_PRESS;
+    kb->repeat_rate = gap;
+    kb->repeat_delay = delay;
+    return KEY_REPEAT;
+}
+
+// Queues a press of an input, read at a given time
+static void kb_press(Keyboard *kb, u8 bit, u64 time) {
+    if (kb->press_num < KB_QUEUE_SIZE)
+        kb->press[kb->press_num++] = (KeyPress) { bit, time };
+    kb->held[bit] = false;
+    kb->held_frames[bit] = 0;
+    if (bit == __builtin_ctz(IN_MV_LEFT))  // the last pressed direction wins
+        kb->held[__builtin_ctz(IN_MV_RIGHT)] = false;
+    if (bit == __builtin_ctz(IN_MV_RIGHT))
+        kb->held[__builtin_ctz(IN_MV_LEFT)] = false;
+}
+
+// Settles the unsure event: the first repeat when the next event of its input
+// came at the repeat rate, else a press, when time ran out or another event came
+static void kb_settle(Keyboard *kb, bool repeat) {
+    u8 bit = kb->unsure;
+
+    kb->unsure = KB_KEYS;
+    if (!repeat) {
+        kb_press(kb, bit, kb->last[bit]);
+        return;
+    }
+    kb->repeat[bit] = true;
+    if (KB_ARR[bit] != 0)
+        kb->held[bit] = true;
+}
+
+// Takes the events read since the last frame apart into presses and repeats
+static void kb_sort(Keyboard *kb, u64 now) {
+    KeyKind kind;
+    u64 gap;
+    u16 in;
+    u8 bit;
+
+    for (u8 i = 0; i < kb->queued; i++) {
+        KeyEvent *ev = &kb->queue[i];
+        if (ev->ch == CH_PAUSE) {
+            kb->pause = true;
+            continue;
+        }
+        if (ev->ch == CH_DEBUG) {
+            kb->debug = true;
+            continue;
+        }
+
+        in = key_input(ev->ch);
+        if (in == IN_NONE)
+            continue;
+
+        bit = __builtin_ctz(in);
+        gap = kb->last[bit] != 0 ? ev->time - kb->last[bit] : UINT64_MAX;
+        if (kb->unsure != KB_KEYS)
+            kb_settle(kb, kb->unsure == bit && kb_near(gap, kb->repeat_rate));
+        kind = kb_kind(kb, bit, gap);
+        kb->repeat[bit] = kind == KEY_REPEAT;
+        kb->gap[bit][1] = kb->gap[bit][0];
+        kb->gap[bit][0] = gap;
+        kb->last[bit] = ev->time;
+        kb->last_bit = bit;
+
+        if (kind == KEY_UNSURE)
+            kb->unsure = bit;
+        else if (kind == KEY_PRESS)
+            kb_press(kb, bit, ev->time);
+        else if (KB_ARR[bit] != 0)
+            kb->held[bit] = true; // terminal repeats of the other keys are dropped
+    }
+    kb->queued = 0;
+
+    // no repeat followed it in time
+    if (kb->unsure != KB_KEYS &&
+        now - kb->last[kb->unsure] > kb->repeat_rate + KB_CADENCE_SLACK_NS + kb->repeat_rate / 8)
+        kb_settle(kb, false);
+}
+
+// Turns the keys read since the last frame into the input of the next one.
+// Presses are applied in the order they were read: a frame takes them while
+// tick() applies each after the ones before it, the rest wait for the next
+// frames, so no press is lost and none overtakes another.
+u16 kb_frame(Keyboard *kb, u64 now) {
+    u16 input = IN_NONE;
+    u8 taken = 0, order = 0;
+    u64 release;
+
+    kb->pause = false;
+    kb->debug = false;
+    memset(kb->pressed, 0, sizeof(kb->pressed));
+    kb_sort(kb, now);
+
+    for (; taken < kb->press_num; taken++) {
+        KeyPress *p = &kb->press[taken];
+        if (input != IN_NONE && KB_ORDER[p->bit] <= order)
+            break;
+        input |= 1 << p->bit;
+        kb->pressed[p->bit] = p->time;
+        order = KB_ORDER[p->bit];
+    }
+    kb->press_num -= taken;
+    memmove(kb->press, kb->press + taken, kb->press_num * sizeof(kb->press[0]));
+
+    // Auto-repeating the held keys
+    release = kb->repeat_rate * 2 + KB_CADENCE_SLACK_NS;
+    for (u8 bit = 0; bit < KB_KEYS; bit++) {
+        if (kb->held[bit] && now - kb->last[bit] > release)
+            kb->held[bit] = false; // released, the terminal stopped repeating it
+        if (kb->held[bit] && kb->held_frames[bit] >= KB_DAS[bit]
+            && (kb->held_frames[bit] - KB_DAS[bit]) % KB_ARR[bit] == 0)
+            input |= 1 << bit;
+        kb->held_frames[bit]++;
+    }
+
+    return input;
+}
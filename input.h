@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include "types.h"
+
+#define KB_QUEUE_SIZE 64
+#define KB_KEYS 8                     // one per input bit
+#define KB_REPEAT_GAP_NS 100000000    // longest time between two terminal repeats
+#define KB_REPEAT_DELAY_NS 1000000000 // longest delay before a terminal starts repeating
+#define KB_CADENCE_SLACK_NS 8000000   // jitter allowed on top of 1/8 of the repeat rate or delay
+#define DAS_FRAMES 10                 // frames before a held move starts repeating
+#define ARR_FRAMES 2                  // frames between repeated moves
+
+typedef struct KeyEvent {
+    i16 ch;
+    u64 time;  // when it was read from the terminal
+} KeyEvent;
+
+typedef struct KeyPress {
+    u8 bit;    // of the IN_ value
+    u64 time;  // when it was read from the terminal
+} KeyPress;
+
+// Keys read between frames and the auto-repeat state of held keys. Terminals
+// only report presses, so a key counts as held while it keeps repeating; an
+// event is taken for a repeat only once the terminal's repeat delay and rate
+// were seen, the ones of a run of at least three evenly spaced events. After
+// that an event one repeat delay after a press may still be a second tap: it
+// waits for the next event of its key, a repeat only when that one follows it
+// at the repeat rate.
+typedef struct Keyboard {
+    KeyEvent queue[KB_QUEUE_SIZE];
+    u8 queued;
+    KeyPress press[KB_QUEUE_SIZE]; // presses not applied yet, in the order they were read
+    u8 press_num;
+    u64 last[KB_KEYS];        // time of the last event of every input
+    u64 gap[KB_KEYS][2];      // between its last events, the latest first
+    bool repeat[KB_KEYS];     // its last event was a terminal repeat
+    u8 last_bit;              // input of the last event, KB_KEYS when none
+    u8 unsure;                // input of the last event when it may be the first repeat, KB_KEYS when none
+    u64 repeat_delay;         // of the terminal, 0 until seen
+    u64 repeat_rate;          // time between its repeats, 0 until seen
+    bool held[KB_KEYS];
+    u32 held_frames[KB_KEYS]; // frames since the key was pressed
+    u64 pressed[KB_KEYS];     // read time of the presses applied by the last frame, 0 if none
+    bool pause;               // the pause key was pressed this frame
+    bool debug;               // the debug overlay key was pressed this frame
+} Keyboard;
+
+void kb_init(Keyboard *kb);
+void kb_read(Keyboard *kb, u64 now);
+u16 kb_frame(Keyboard *kb, u64 now);
@@ -0,0 +1,52 @@
+#include "latency.h"
+#include "game.h"
+
+#define LAT_BUCKET_NS 250000 // up to 64 ms
+
+static const char *LAT_NAMES[LAT_ACTIONS] = {
+    "move", "rotate", "soft drop", "hard drop", "hold"
+};
+
+// Action of every input bit, LAT_ACTIONS for the untracked ones
+static const u8 LAT_ACTION[KB_KEYS] = {
+    LAT_MOVE, LAT_MOVE, LAT_ROTATE, LAT_ROTATE, LAT_SOFT_DROP, LAT_HARD_DROP, LAT_HOLD, LAT_ACTIONS
+};
+
+void lat_init(Latency *lat) {
+    *lat = (Latency) { 0 };
+    for (u8 a = 0; a < LAT_ACTIONS; a++) {
+        hist_init(&lat->to_tick[a], LAT_BUCKET_NS);
+        hist_init(&lat->to_screen[a], LAT_BUCKET_NS);
+    }
+}
+
+// Records the keys pressed in the frame which was just ticked
+void lat_tick(Latency *lat, const Keyboard *kb, u64 now) {
+    for (u8 bit = 0; bit < KB_KEYS; bit++) {
+        u8 action = LAT_ACTION[bit];
+        if (kb->pressed[bit] == 0 || action == LAT_ACTIONS)
+            continue;
+
+        hist_add(&lat->to_tick[action], now - kb->pressed[bit]);
+        if (lat->pending_num < LAT_PENDING)
+            lat->pending[lat->pending_num++] = (LatKey) { kb->pressed[bit], action };
+    }
+}
+
+// Records the keys whose frame was just sent to the terminal
+void lat_flush(Latency *lat, u64 now) {
+    for (u8 i = 0; i < lat->pending_num; i++)
+        hist_add(&lat->to_screen[lat->pending[i].action], now - lat->pending[i].read);
+    lat->pending_num = 0;
+}
+
+void lat_dump(Latency *lat, FILE *file) {
+    char name[64];
+
+    for (u8 a = 0; a < LAT_ACTIONS; a++) {
+        snprintf(name, sizeof(name), "%s, read to tick", LAT_NAMES[a]);
+        hist_dump(&lat->to_tick[a], file, name);
+        snprintf(name, sizeof(name), "%s, read to screen", LAT_NAMES[a]);
+        hist_dump(&lat->to_screen[a], file, name);
+    }
+}
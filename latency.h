@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+#include "stats.h"
+#include "input.h"
+
+#define LAT_PENDING 32 // keys applied but not on the screen yet
+
+typedef enum LatAction {
+    LAT_MOVE, LAT_ROTATE, LAT_SOFT_DROP, LAT_HARD_DROP, LAT_HOLD, LAT_ACTIONS
+} LatAction;
+
+typedef struct LatKey {
+    u64 read;
+    u8 action;
+} LatKey;
+
+// Input latency per action: from reading a key to the tick applying it and
+// to the doupdate() sending the resulting frame to the terminal
+typedef struct Latency {
+    Hist to_tick[LAT_ACTIONS];
+    Hist to_screen[LAT_ACTIONS];
+    LatKey pending[LAT_PENDING];
+    u8 pending_num;
+} Latency;
+
+void lat_init(Latency *lat);
+void lat_tick(Latency *lat, const Keyboard *kb, u64 now);
+void lat_flush(Latency *lat, u64 now);
+void lat_dump(Latency *lat, FILE *file);
@@ -0,0 +1,294 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "pacer.h"
+#include "pool.h"
+#include "rand.h"
+#include "server.h"
+
+// Load generator for tetris-server: keeps a number of clients connected,
+// every one pressing random keys like the random player of tetris-sim,
+// and measures how long the game state takes to come back after a hard drop.
+// A client whose game ended connects again.
+
+#define DEFAULT_CLIENTS 1000
+#define DEFAULT_SECONDS 10
+#define LATENCY_BUCKET_NS 100000 // up to 25.6 ms
+
+typedef struct Client {
+    int fd;
+    u8 in[SRV_MSG_MAX];  // game state being read
+    u16 in_len;          // its bytes read so far
+    u64 dropped_at;      // when a hard drop was sent, 0 when none is waiting for its state
+    u32 quiet;           // frames since the last game state
+    u64 rng;
+} Client;
+
+typedef struct Load Load;
+
+typedef struct Runner {
+    Load *load;
+    pthread_t thread;
+    Client *client;
+    u32 num;
+    int epfd;
+    Pacer pacer;
+    Game scratch;
+    Paint scratch_paint;
+    u64 connects;
+    u64 keys;            // key bytes sent
+    u64 states;          // game states received
+    u64 invalid;         // ones snap_unpack() rejected
+    Hist latency;        // from sending a hard drop to receiving the next game state
+} Runner;
+
+struct Load {
+    const char *path;
+    u64 until;           // when the clients stop
+};
+
+// Connects a client to the server and watches it, false when the server is gone
+static bool client_connect(Runner *runner, Client *c) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+
+    c->fd = -1;
+    c->in_len = 0;
+    c->dropped_at = 0;
+    c->quiet = 0;
+    if (strlen(runner->load->path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, runner->load->path);
+
+    if ((c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return false;
+    if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK) != 0 ||
+        epoll_ctl(runner->epfd, EPOLL_CTL_ADD, c->fd, &ev) != 0) {
+        close(c->fd);
+        c->fd = -1;
+        return false;
+    }
+    runner->connects++;
+    return true;
+}
+
+// Reads the game states which arrived; the server closing the session
+// ends the game, so the client connects again
+static bool client_read(Runner *runner, Client *c) {
+    u8 buf[4096];
+    ssize_t n;
+    u16 need;
+
+    for (;;) {
+        n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return true;
+        if (n <= 0) {
+            close(c->fd);
+            return client_connect(runner, c);
+        }
+
+        for (ssize_t i = 0; i < n;) {
+            need = c->in_len == 0 ? 1 : 1 + c->in[0];
+            while (c->in_len < need && i < n)
+                c->in[c->in_len++] = buf[i++];
+            if (c->in_len < need || need == 1)
+                continue;
+
+            if (snap_unpack(&runner->scratch, &runner->scratch_paint, c->in + 1, c->in[0]) == 0)
+                runner->invalid++;
+            if (c->dropped_at != 0) {
+                hist_add(&runner->latency, now_ns() - c->dropped_at);
+                c->dropped_at = 0;
+            }
+            runner->states++;
+            c->in_len = 0;
+            c->quiet = 0;
+        }
+    }
+}
+
+// Presses a random key of every client; hard drops only once the entry delay
+// after the last lock is over, so every one locks a tetromino and is timed
+static void runner_frame(Runner *runner) {
+    Client *c;
+    u8 input;
+
+    for (u32 i = 0; i < runner->num; i++) {
+        c = &runner->client[i];
+        c->quiet++;
+        if (c->fd < 0 || (input = rand_input(&c->rng)) == IN_NONE)
+            continue;
+        if (input == IN_HARD_DROP && (c->dropped_at != 0 || c->quiet <= ENTRY_DELAY + 1))
+            continue;
+        if (send(c->fd, &input, 1, MSG_NOSIGNAL) != 1)
+            continue; // the server is behind, or the session ends and shows up as read
+        runner->keys++;
+        if (input == IN_HARD_DROP && c->dropped_at == 0)
+            c->dropped_at = now_ns();
+    }
+}
+
+static void *runner_main(void *arg) {
+    Runner *runner = arg;
+    struct epoll_event ev[SRV_EVENTS];
+    bool frame;
+    int n;
+
+    pacer_arm(&runner->pacer);
+    while (now_ns() < runner->load->until) {
+        if ((n = epoll_wait(runner->epfd, ev, SRV_EVENTS, -1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        frame = false;
+        for (int i = 0; i < n; i++) {
+            if (ev[i].data.ptr == NULL)
+                frame = true;
+            else if (!client_read(runner, ev[i].data.ptr))
+                return NULL;
+        }
+        if (frame) {
+            pacer_fired(&runner->pacer);
+            runner_frame(runner);
+            pacer_arm(&runner->pacer);
+        }
+    }
+    return NULL;
+}
+
+static bool runner_init(Runner *runner, Load *load, u32 num, u64 seed) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // the timer
+
+    *runner = (Runner) { .load = load, .num = num };
+    hist_init(&runner->latency, LATENCY_BUCKET_NS);
+    if ((runner->client = calloc(num, sizeof(Client))) == NULL || !pacer_init(&runner->pacer, FRAMERATE))
+        return false;
+    if ((runner->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        epoll_ctl(runner->epfd, EPOLL_CTL_ADD, runner->pacer.fd, &ev) != 0)
+        return false;
+
+    for (u32 i = 0; i < num; i++) {
+        runner->client[i].rng = seed + i;
+        if (!client_connect(runner, &runner->client[i]))
+            return false;
+    }
+    return true;
+}
+
+static void runner_free(Runner *runner) {
+    for (u32 i = 0; i < runner->num; i++)
+        if (runner->client[i].fd >= 0)
+            close(runner->client[i].fd);
+    free(runner->client);
+    pacer_close(&runner->pacer);
+    close(runner->epfd);
+}
+
+// Adds the samples of a histogram to another one with the same buckets
+static void hist_merge(Hist *hist, const Hist *other) {
+    for (u32 b = 0; b < HIST_BUCKETS; b++)
+        hist->count[b] += other->count[b];
+    hist->n += other->n;
+    hist->sum += other->sum;
+    if (other->max > hist->max)
+        hist->max = other->max;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-a socket_path] [-c clients] [-j threads] [-t seconds] [-s seed] [-l latency]\n", name);
+}
+
+int main(int argc, char **argv) {
+    Load load = { .path = SRV_SOCKET };
+    u32 clients = DEFAULT_CLIENTS, threads = cpu_count(), seconds = DEFAULT_SECONDS;
+    u64 seed = 1, connects = 0, keys = 0, states = 0, invalid = 0, start;
+    const char *latency_path = NULL;
+    Runner *runner;
+    Hist latency;
+    FILE *file;
+    f64 elapsed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:c:j:t:s:l:h")) != -1) {
+        switch (opt) {
+            case 'a': load.path = optarg; break;
+            case 'c': clients = strtoul(optarg, NULL, 10); break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 't': seconds = strtoul(optarg, NULL, 10); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'l': latency_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (threads == 0 || clients == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads > clients)
+        threads = clients;
+
+    // a client takes a file
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((runner = calloc(threads, sizeof(Runner))) == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    for (u32 t = 0; t < threads; t++) {
+        u32 num = clients / threads + (t < clients % threads);
+        if (!runner_init(&runner[t], &load, num, seed + (u64) t * clients)) {
+            perror(load.path);
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    load.until = start + seconds * 1000000000ULL;
+    for (u32 t = 0; t < threads; t++)
+        pthread_create(&runner[t].thread, NULL, runner_main, &runner[t]);
+
+    hist_init(&latency, LATENCY_BUCKET_NS);
+    for (u32 t = 0; t < threads; t++) {
+        pthread_join(runner[t].thread, NULL);
+        connects += runner[t].connects;
+        keys += runner[t].keys;
+        states += runner[t].states;
+        invalid += runner[t].invalid;
+        hist_merge(&latency, &runner[t].latency);
+        runner_free(&runner[t]);
+    }
+    elapsed = (now_ns() - start) / 1.0e9;
+
+    printf("clients:    %u (%" PRIu64 " sessions)\n", clients, connects);
+    printf("threads:    %u\n", threads);
+    printf("time:       %.3f s\n", elapsed);
+    printf("keys/s:     %.0f\n", keys / elapsed);
+    printf("states/s:   %.0f (%" PRIu64 " invalid)\n", states / elapsed, invalid);
+    printf("latency:    %.2f ms p50, %.2f ms p99, %.2f ms max\n", hist_percentile(&latency, 0.5) / 1.0e6,
+           hist_percentile(&latency, 0.99) / 1.0e6, latency.max / 1.0e6);
+
+    if (latency_path != NULL && (file = fopen(latency_path, "w")) != NULL) {
+        hist_dump(&latency, file, "hard drop to game state");
+        fclose(file);
+    }
+    free(runner);
+    return invalid == 0 ? 0 : 2;
+}
@@ -0,0 +1,167 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rollback.h"
+#include "rand.h"
+
+// Plays both sides of a rollback versus game in one process, in the order of
+// the versus loop of tetris: play a frame when ready, send its input, take
+// the remote inputs which arrived, play again the mispredicted frames.
+// The inputs cross a simulated link with random delays, and the sides run
+// at random speeds, one of them starting up to LS_LEAD frames late. Every
+// game has to end on both sides, with the state of versus_tick() played
+// with the same inputs; a side waiting on the other forever is a deadlock.
+
+#define DEFAULT_RUNS 200
+#define LS_FRAMES 20000      // frames a game is cut at when nobody lost
+#define LS_LEAD (2 * RB_WINDOW)
+#define LS_DELAY 8           // steps an input may take to cross, more for 1 in LS_SPIKE
+#define LS_SPIKE 64
+#define LS_STALL 10          // percent chance of a side skipping a step
+
+typedef struct Msg {
+    u32 frame;
+    u16 input;
+    u64 arrival;             // step it arrives at
+} Msg;
+
+// Inputs sent by a side, in order; the other one takes them from head
+typedef struct Channel {
+    Msg msg[LS_FRAMES];
+    u32 head;
+    u32 num;
+} Channel;
+
+typedef struct Lockstep {
+    Rollback rb[VS_PLAYERS];
+    Channel chan[VS_PLAYERS];
+    u16 input[LS_FRAMES][VS_PLAYERS];  // every input played, for the reference
+    Versus ref;
+    u64 rng;
+    u64 frames;
+    u64 rollbacks;
+    u64 replayed;
+} Lockstep;
+
+// Whether a side is done: its game ended, or it was cut and all its inputs are known
+static bool side_done(const Rollback *rb) {
+    return rb_over(rb) || (rb->frame == LS_FRAMES && rb->confirmed == LS_FRAMES && rb->rewind == RB_NONE);
+}
+
+// Runs a step of a side, returns false when the other one sent an input rb_remote() rejected
+static bool side_step(Lockstep *ls, u8 p, u64 step) {
+    Rollback *rb = &ls->rb[p];
+    Channel *out = &ls->chan[p], *in = &ls->chan[!p];
+    Msg *msg;
+    u64 delay;
+
+    if (rb_ready(rb) && rb->frame < LS_FRAMES) {
+        delay = rand_next(&ls->rng) % LS_SPIKE == 0 ? LS_DELAY * 4 : rand_next(&ls->rng) % (LS_DELAY + 1);
+        msg = &out->msg[out->num];
+        *msg = (Msg) { rb->frame, rand_input(&ls->rng), step + delay };
+        // a stream keeps the inputs in order
+        if (out->num > 0 && msg->arrival < out->msg[out->num - 1].arrival)
+            msg->arrival = out->msg[out->num - 1].arrival;
+        out->num++;
+
+        ls->input[rb->frame][p] = msg->input;
+        rb_advance(rb, msg->input);
+    }
+
+    for (; in->head < in->num && in->msg[in->head].arrival <= step; in->head++)
+        if (!rb_remote(rb, in->msg[in->head].frame, in->msg[in->head].input))
+            return false;
+    rb_sync(rb);
+    return true;
+}
+
+// Plays a game on both sides and checks it against the reference,
+// returns false and prints why when it fails
+static bool lockstep(Lockstep *ls, u64 seed) {
+    u64 step, late, idle = 0;
+    u32 frames;
+    u8 p;
+
+    for (p = 0; p < VS_PLAYERS; p++) {
+        rb_init(&ls->rb[p], seed, p);
+        ls->chan[p].head = ls->chan[p].num = 0;
+    }
+    ls->rng = seed;
+    late = rand_next(&ls->rng) % (LS_LEAD + 1);
+
+    for (step = 0; !side_done(&ls->rb[0]) || !side_done(&ls->rb[1]); step++) {
+        u32 before = ls->rb[0].frame + ls->rb[0].confirmed + ls->rb[1].frame + ls->rb[1].confirmed;
+
+        for (p = 0; p < VS_PLAYERS; p++) {
+            if (side_done(&ls->rb[p]) || (p == 1 && step < late) || rand_next(&ls->rng) % 100 < LS_STALL)
+                continue;
+            if (!side_step(ls, p, step)) {
+                printf("seed %" PRIu64 ": input rejected by side %u\n", seed, p);
+                return false;
+            }
+        }
+
+        // nothing played nor taken while all sent inputs are delivered
+        idle = before == ls->rb[0].frame + ls->rb[0].confirmed + ls->rb[1].frame + ls->rb[1].confirmed ? idle + 1 : 0;
+        if (idle > LS_DELAY * 4 + LS_LEAD + 100) {
+            printf("seed %" PRIu64 ": DEADLOCK at frames %u/%u, confirmed %u/%u\n", seed,
+                   ls->rb[0].frame, ls->rb[1].frame, ls->rb[0].confirmed, ls->rb[1].confirmed);
+            return false;
+        }
+    }
+
+    // the reference, played frame by frame with the inputs both sides chose
+    frames = ls->rb[0].vs.frame;
+    versus_init(&ls->ref, seed);
+    for (u32 f = 0; f < frames; f++)
+        versus_tick(&ls->ref, ls->input[f]);
+
+    for (p = 0; p < VS_PLAYERS; p++) {
+        const Versus *vs = &ls->rb[p].vs;
+        bool same = vs->frame == ls->ref.frame && vs->lost == ls->ref.lost && vs->rng == ls->ref.rng &&
+                    memcmp(vs->pending, ls->ref.pending, sizeof(vs->pending)) == 0 &&
+                    memcmp(vs->sent, ls->ref.sent, sizeof(vs->sent)) == 0;
+        for (u8 g = 0; g < VS_PLAYERS && same; g++)
+            same = vs->game[g].score == ls->ref.game[g].score && vs->game[g].hash == ls->ref.game[g].hash &&
+                   memcmp(vs->game[g].board, ls->ref.game[g].board, sizeof(vs->game[g].board)) == 0;
+        if (!same) {
+            printf("seed %" PRIu64 ": MISMATCH of side %u after %u frames\n", seed, p, frames);
+            return false;
+        }
+        ls->rollbacks += ls->rb[p].rollbacks;
+        ls->replayed += ls->rb[p].replayed;
+    }
+    ls->frames += frames;
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n runs] [-s seed]\n", name);
+}
+
+int main(int argc, char **argv) {
+    static Lockstep ls;
+    u32 runs = DEFAULT_RUNS, failed = 0;
+    u64 seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+            case 'n': runs = strtoul(optarg, NULL, 10); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    for (u32 r = 0; r < runs; r++)
+        if (!lockstep(&ls, seed + r))
+            failed++;
+
+    printf("runs:      %u (%u failed)\n", runs, failed);
+    printf("frames:    %" PRIu64 "\n", ls.frames);
+    printf("rollbacks: %" PRIu64 " (%" PRIu64 " frames played again)\n", ls.rollbacks, ls.replayed);
+    return failed == 0 ? 0 : 2;
+}
@@ -1,83 +1,351 @@
 #include <curses.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "utils.h"
-#include "win_loc_dim.h"
 #include "game.h"
 #include "draw.h"
+#include "replay.h"
+#include "pacer.h"
+#include "input.h"
+#include "latency.h"
+#include "bot.h"
+#include "net.h"
+#include "rollback.h"
 
-int main() {
-    bool run = true;
-    i16 ch;
-    u8 blink_frame;
-    Windim scrdim;
-    struct timespec timestamp, sleep_time;
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s seed] [-w replay] [-t stats] [-l latency] [-d] [-b [-c pieces]]\n"
+                    "       %s -p replay [-R redraws_per_second] [-S start_frame]\n"
+                    "       %s -v socket_path|host:port [-s seed] [-d]\n", name, name, name);
+}
+
+// Plays a replay back as fast as possible, redrawing the screen
+// at most rate times per second (never when rate is 0)
+static int playback(const char *path, u32 rate, u64 start_frame) {
+    Replay rp;
+    Game game;
+    Paint paint;
+    Display disp;
+    struct timespec now, last_draw = { 0, 0 };
+    bool match;
+
+    if (!replay_open(&rp, path)) {
+        fprintf(stderr, "%s: not a valid replay\n", path);
+        return 1;
+    }
+
+    game_init(&game, rp.seed);
+    paint_init(&paint);
+    if (start_frame > 0 && !replay_seek(&rp, &game, &paint, start_frame)) {
+        fprintf(stderr, "%s: not a valid replay\n", path);
+        replay_close(&rp);
+        return 1;
+    }
+
+    if (rate > 0) {
+        init_ncurses();
+        init_display(&disp, 0, 1);
+    }
 
-    WINDOW *win[WINDOW_NUM];
+    while (!replay_done(&rp)) {
+        tick(&game, replay_input(&rp));
+        paint_update(&paint, &game);
 
-    srand(time(NULL));
+        if (rate > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((now.tv_sec - last_draw.tv_sec) + (now.tv_nsec - last_draw.tv_nsec) / 1.0e9 >= 1.0 / rate) {
+                draw_game(&disp, &game, &paint);
+                last_draw = now;
+            }
+            if (getch() == CH_QUIT)
+                break;
+        }
+    }
+
+    if (rate > 0)
+        endwin();
+
+    match = replay_done(&rp) && game.score == rp.end_score && game.lines_cleared == rp.end_lines;
+    printf("FRAMES: %" PRIu64 " | LEVEL: %hu | SCORE: %u | LINES: %u | SEED: %" PRIu64 " | %s\n",
+           rp.frame, game.level, game.score, game.lines_cleared, rp.seed,
+           match ? "MATCH" : "MISMATCH");
+    replay_close(&rp);
+    return match ? 0 : 2;
+}
+
+static volatile sig_atomic_t latency_requested = 0;
+
+static void request_latency(int sig) {
+    (void) sig;
+    latency_requested = 1;
+}
+
+// Overwrites a statistics file, NULL when it can't be created
+static FILE *stats_open(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        perror(path);
+    return file;
+}
+
+// Reads keys as they arrive until the next frame is due
+static void wait_frame(Pacer *pacer, Keyboard *kb) {
+    static struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN } };
+
+    fds[1] = (struct pollfd) { .fd = pacer->fd, .events = POLLIN };
+    pacer_arm(pacer);
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[0].revents & POLLIN)
+            kb_read(kb, now_ns());
+        if (fds[0].revents & (POLLHUP | POLLERR))
+            fds[0].fd = -1; // the terminal is gone, stop watching it
+        if (fds[1].revents & POLLIN)
+            break;
+    }
+    pacer_fired(pacer);
+}
+
+// Plays against another tetris started with the same address, the local game
+// on the left; the remote one is drawn as the rollback last predicted it
+static int versus(const char *addr, u64 seed, bool debug) {
+    Link link;
+    static Rollback rb;
+    Display disp[VS_PLAYERS];
+    Pacer pacer;
+    Keyboard kb;
+    u8 local;
+    u32 frame;
+    u16 input;
+    u64 start, written;
+    int got = 0;
+
+    if (!link_open(&link, addr, &seed, &local)) {
+        perror(addr);
+        return 1;
+    }
+    rb_init(&rb, seed, local);
 
     init_ncurses();
+    for (u8 p = 0; p < VS_PLAYERS; p++)
+        init_display(&disp[p], p == local ? 0 : 1, VS_PLAYERS);
+    if (debug)
+        toggle_debug(&disp[local]);
+
+    if (!pacer_init(&pacer, FRAMERATE)) {
+        endwin();
+        link_close(&link);
+        perror("timerfd");
+        return 1;
+    }
+    kb_init(&kb);
+
+    while (got >= 0 && !rb_over(&rb)) {
+        kb_read(&kb, now_ns());
+        if (rb_ready(&rb)) { // else the keys stay queued until the remote inputs catch up
+            input = kb_frame(&kb, now_ns());
+            if (kb.debug)
+                toggle_debug(&disp[local]);
+            if (!link_send(&link, rb.frame, input))
+                break;
+            start = disp[local].debug ? now_ns() : 0;
+            rb_advance(&rb, input);
+        } else {
+            start = disp[local].debug ? now_ns() : 0;
+        }
+
+        while ((got = link_recv(&link, &frame, &input)) > 0) {
+            if (!rb_remote(&rb, frame, input)) {
+                got = -1;
+                break;
+            }
+        }
+        rb_sync(&rb);
+        if (disp[local].debug)
+            roll_add(&disp[local].stats.tick, now_ns() - start);
+
+        for (u8 p = 0; p < VS_PLAYERS; p++)
+            draw_game(&disp[p], &rb.vs.game[p], &rb.vs.paint[p]);
+
+        wait_frame(&pacer, &kb);
+
+        if (disp[local].debug) {
+            written = bytes_written();
+            roll_add(&disp[local].stats.slack, pacer.slack);
+            roll_add(&disp[local].stats.bytes, written - disp[local].stats.written);
+            disp[local].stats.written = written;
+            disp[local].stats.missed = pacer.late + pacer.skipped;
+        }
+    }
+
+    if (rb_over(&rb))
+        sleep(1);
+    endwin();
+    pacer_close(&pacer);
+    link_close(&link);
 
-    Game game = {
-        .score = 0,
-        .lines_cleared = 0,
-        .level = 1,
-        .combo = -1,
-        .bag = { 0, 1, 2, 3, 4, 5, 6 },
-        .bag_index = 0,
-        .on_floor = false,
-        .swapped = false,
-        .entry_delay = 0,
-        .gravity_acted = false,
-        .paused = false,
-    };
-
-    for (u8 y = 0; y < FIELD_Y; y++) {
-        for (u8 x = 0; x < FIELD_X; x++) {
-            game.field[y][x] = BLACK;
+    printf("%s | FRAMES: %u | SCORE: %u | SENT: %u | ROLLBACKS: %" PRIu64 " | REPLAYED: %" PRIu64 " | SEED: %" PRIu64 "\n",
+           !rb_over(&rb) ? "DISCONNECTED" : rb.vs.lost == (1 << VS_PLAYERS) - 1 ? "DRAW" :
+           rb.vs.lost & (1 << local) ? "LOST" : "WON",
+           rb.vs.frame, rb.vs.game[local].score, rb.vs.sent[local], rb.rollbacks, rb.replayed, seed);
+    return rb_over(&rb) ? 0 : 2;
+}
+
+int main(int argc, char **argv) {
+    bool run = true, debug = false, autoplay = false;
+    i16 ch = ERR;
+    u16 input;
+    u64 start, written;
+    Display disp;
+    Game game;
+    Paint paint;
+    u64 seed = time(NULL);
+    const char *record_path = NULL, *replay_path = NULL, *stats_path = NULL, *latency_path = NULL;
+    const char *versus_addr = NULL;
+    u32 rate = 0;
+    u64 start_frame = 0;
+    u8 pc_pieces = 0;
+    Recorder rec;
+    int opt;
+    Pacer pacer;
+    Keyboard kb;
+    Latency lat;
+    Pool *pool = NULL;
+    Bot bot;
+    FILE *stats;
+
+    while ((opt = getopt(argc, argv, "s:w:p:R:S:t:l:dbc:v:h")) != -1) {
+        switch (opt) {
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'w': record_path = optarg; break;
+            case 'p': replay_path = optarg; break;
+            case 'R': rate = strtoul(optarg, NULL, 10); break;
+            case 'S': start_frame = strtoull(optarg, NULL, 10); break;
+            case 't': stats_path = optarg; break;
+            case 'l': latency_path = optarg; break;
+            case 'd': debug = true; break;
+            case 'b': autoplay = true; break;
+            case 'c': pc_pieces = strtoul(optarg, NULL, 10); break;
+            case 'v': versus_addr = optarg; break;
+            default: usage(argv[0]); return 1;
         }
     }
 
-    scrdim = get_scrdim();
-    // Scaling the windows if there is enough space
-    if (scrdim.cols >= 62 && scrdim.rows >= 42)
-        game.block_size = (Vec) { 2, 4 };
-    else
-        game.block_size = (Vec) { 1, 2 };
+    if (replay_path != NULL)
+        return playback(replay_path, rate, start_frame);
+    if (versus_addr != NULL)
+        return versus(versus_addr, seed, debug);
+
+    if (record_path != NULL && !rec_open(&rec, record_path, seed, KEYFRAME_INTERVAL)) {
+        perror(record_path);
+        return 1;
+    }
+
+    if (autoplay && ((pool = pool_create(cpu_count())) == NULL || !bot_init(&bot, pool, BOT_BUDGET_NS) ||
+                     (pc_pieces > 0 && !bot_perfect_clears(&bot, pc_pieces)))) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
 
-    game.tm_next = tm_create_rand(&game);
-    game.tm_hold = tm_create_rand(&game);
-    game.tm_hold.type = BLACK;
-    tm_spawn(&game);
+    init_ncurses();
 
-    win[WIN_FIELD]  = create_win(WINLOC_FIELD_Y, WINLOC_FIELD_X, WINDIM_FIELD_Y, WINDIM_FIELD_X);
-    win[WIN_NEXTTM] = create_win(WINLOC_NEXTTM_Y, WINLOC_NEXTTM_X, WINDIM_NEXTTM_Y, WINDIM_NEXTTM_X);
-    win[WIN_HOLDTM] = create_win(WINLOC_HOLDTM_Y, WINLOC_HOLDTM_X, WINDIM_HOLDTM_Y, WINDIM_HOLDTM_X);
-    win[WIN_SCORE]  = create_win(WINLOC_SCORE_Y, WINLOC_SCORE_X, WINDIM_SCORE_Y, WINDIM_SCORE_X);
-    win[WIN_LEVEL]  = create_win(WINLOC_LEVEL_Y, WINLOC_LEVEL_X, WINDIM_LEVEL_Y, WINDIM_LEVEL_X);
+    game_init(&game, seed);
+    paint_init(&paint);
+
+    init_display(&disp, 0, 1);
+    if (debug)
+        toggle_debug(&disp);
+
+    if (!pacer_init(&pacer, FRAMERATE)) {
+        endwin();
+        perror("timerfd");
+        return 1;
+    }
+    kb_init(&kb);
+    if (latency_path != NULL) {
+        lat_init(&lat);
+        signal(SIGUSR1, request_latency);
+    }
 
-    clock_gettime(CLOCK_REALTIME, &timestamp);
     while (run) {
-        if (!tick(&game, ch))
+        kb_read(&kb, now_ns());
+        input = kb_frame(&kb, now_ns());
+        if (autoplay)
+            input = (input & IN_QUIT) | bot_input(&bot, &game);
+        if (kb.debug)
+            toggle_debug(&disp);
+        if (record_path != NULL)
+            rec_frame(&rec, &game, input);
+
+        start = disp.debug ? now_ns() : 0;
+        if (!tick(&game, input)) {
+            if (game.over)
+                sleep(1);
             run = !run;
+        }
+        paint_update(&paint, &game);
+        if (disp.debug)
+            roll_add(&disp.stats.tick, now_ns() - start);
+        if (latency_path != NULL)
+            lat_tick(&lat, &kb, now_ns());
 
-        draw_game(&win[0], &game, &blink_frame);
+        if (draw_game(&disp, &game, &paint) && latency_path != NULL)
+            lat_flush(&lat, now_ns());
+
+        // a failed dump isn't retried every frame, the next signal asks again
+        if (latency_requested) {
+            latency_requested = 0;
+            if ((stats = stats_open(latency_path)) != NULL) {
+                lat_dump(&lat, stats);
+                fclose(stats);
+            }
+        }
 
-        ch = getch();
-        if (ch == CH_PAUSE)
-            if (!pause_game(win[WIN_FIELD], &game, &ch))
+        if (kb.pause) {
+            if (!pause_game(&disp, &game, &paint, &ch))
                 run = !run;
+            pacer_reset(&pacer);
+        }
+
+        wait_frame(&pacer, &kb);
 
-        sleep_time = time_to_sleep(timestamp);
-        nanosleep(&sleep_time, NULL);
-        clock_gettime(CLOCK_REALTIME, &timestamp);
+        if (disp.debug) {
+            written = bytes_written();
+            roll_add(&disp.stats.slack, pacer.slack);
+            roll_add(&disp.stats.bytes, written - disp.stats.written);
+            disp.stats.written = written;
+            disp.stats.missed = pacer.late + pacer.skipped;
+        }
     }
 
     endwin();
-    printf("LEVEL: %hu | SCORE: %u\n", game.level, game.score);
+    pacer_close(&pacer);
+    if (autoplay) {
+        bot_free(&bot);
+        pool_destroy(pool);
+    }
+    if (record_path != NULL && !rec_close(&rec, &game))
+        fprintf(stderr, "%s: failed to write the replay\n", record_path);
+    printf("LEVEL: %hu | SCORE: %u | SEED: %" PRIu64 "\n", game.level, game.score, seed);
+
+    if (stats_path != NULL && (stats = stats_open(stats_path)) != NULL) {
+        pacer_dump(&pacer, stats);
+        fclose(stats);
+    }
+    if (latency_path != NULL && (stats = stats_open(latency_path)) != NULL) {
+        lat_dump(&lat, stats);
+        fclose(stats);
+    }
     return 0;
 }
@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "net.h"
+
+typedef struct Address {
+    struct sockaddr_storage sa;
+    socklen_t len;
+    int family;
+} Address;
+
+// Resolves a UNIX socket path or host:port, an empty host is the loopback one
+static bool resolve(const char *addr, Address *out) {
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *res;
+    struct sockaddr_un *un = (struct sockaddr_un *) &out->sa;
+    const char *colon = strrchr(addr, ':');
+    char host[256];
+
+    if (colon == NULL) {
+        if (strlen(addr) >= sizeof(un->sun_path))
+            return false;
+        *un = (struct sockaddr_un) { .sun_family = AF_UNIX };
+        strcpy(un->sun_path, addr);
+        out->len = sizeof(*un);
+        out->family = AF_UNIX;
+        return true;
+    }
+
+    if ((size_t) (colon - addr) >= sizeof(host))
+        return false;
+    memcpy(host, addr, colon - addr);
+    host[colon - addr] = '\0';
+    if (getaddrinfo(host[0] != '\0' ? host : NULL, colon + 1, &hints, &res) != 0)
+        return false;
+    memcpy(&out->sa, res->ai_addr, res->ai_addrlen);
+    out->len = res->ai_addrlen;
+    out->family = res->ai_family;
+    freeaddrinfo(res);
+    return true;
+}
+
+static bool send_all(int fd, const u8 *buf, size_t len) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = send(fd, buf, len, MSG_NOSIGNAL)) > 0) {
+            buf += n;
+            len -= n;
+        } else if (n < 0 && errno == EAGAIN) {
+            poll(&pfd, 1, -1);
+        } else if (n == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool recv_all(int fd, u8 *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = recv(fd, buf, len, 0)) > 0) {
+            buf += n;
+            len -= n;
+        } else if (n == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Connects to the side listening, -1 when there is none
+static int connect_to(const Address *addr) {
+    int fd = socket(addr->family, SOCK_STREAM | SOCK_CLOEXEC, 0), err;
+
+    if (fd < 0 || connect(fd, (const struct sockaddr *) &addr->sa, addr->len) == 0)
+        return fd;
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+// Listens for the other side and accepts it, -1 when the address is taken
+static int accept_from(const Address *addr) {
+    int lfd = socket(addr->family, SOCK_STREAM | SOCK_CLOEXEC, 0), fd, one = 1, err;
+
+    if (lfd < 0)
+        return -1;
+    if (addr->family != AF_UNIX)
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, (const struct sockaddr *) &addr->sa, addr->len) != 0 || listen(lfd, 1) != 0) {
+        err = errno;
+        close(lfd);
+        errno = err;
+        return -1;
+    }
+
+    while ((fd = accept(lfd, NULL, NULL)) < 0 && errno == EINTR);
+    err = errno;
+    close(lfd);
+    if (addr->family == AF_UNIX) // a new game can take the path
+        unlink(((const struct sockaddr_un *) &addr->sa)->sun_path);
+    errno = err;
+    return fd;
+}
+
+// Connects the two sides, waiting for the other one when this one listens;
+// the seed of the listening side is the one played
+bool link_open(Link *link, const char *addr, u64 *seed, u8 *player) {
+    struct timespec wait = { 0, NET_RETRY_NS };
+    Address address;
+    u8 hello[8];
+    u8 refused = 0;
+    int one = 1;
+
+    *link = (Link) { .fd = -1 };
+    if (!resolve(addr, &address)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    for (u32 retry = 0; link->fd < 0 && retry < NET_RETRIES; retry++) {
+        if ((link->fd = connect_to(&address)) >= 0) {
+            *player = 1;
+            break;
+        }
+
+        // a UNIX socket refusing twice in a row was left by a side that is gone
+        refused = address.family == AF_UNIX && errno == ECONNREFUSED ? refused + 1 : 0;
+        if (refused >= 2)
+            unlink(((struct sockaddr_un *) &address.sa)->sun_path);
+        if ((link->fd = accept_from(&address)) >= 0) {
+            *player = 0;
+            break;
+        }
+        if (errno != EADDRINUSE)
+            return false;
+        nanosleep(&wait, NULL);
+    }
+    if (link->fd < 0)
+        return false;
+
+    if (address.family != AF_UNIX)
+        setsockopt(link->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (*player == 0) {
+        for (u8 i = 0; i < 8; i++)
+            hello[i] = *seed >> (8 * i);
+        if (!send_all(link->fd, hello, sizeof(hello)))
+            goto fail;
+    } else {
+        if (!recv_all(link->fd, hello, sizeof(hello)))
+            goto fail;
+        *seed = 0;
+        for (u8 i = 0; i < 8; i++)
+            *seed |= (u64) hello[i] << (8 * i);
+    }
+
+    if (fcntl(link->fd, F_SETFL, fcntl(link->fd, F_GETFL) | O_NONBLOCK) == 0)
+        return true;
+fail:
+    link_close(link);
+    return false;
+}
+
+void link_close(Link *link) {
+    if (link->fd >= 0)
+        close(link->fd);
+    link->fd = -1;
+}
+
+// Sends the local input of a frame
+bool link_send(Link *link, u32 frame, u16 input) {
+    u8 msg[NET_MSG_SIZE] = { frame, frame >> 8, frame >> 16, frame >> 24, input, input >> 8 };
+    return send_all(link->fd, msg, sizeof(msg));
+}
+
+// Reads the next remote input: 1 when a whole message arrived, 0 when not yet,
+// -1 when the other side closed the link
+int link_recv(Link *link, u32 *frame, u16 *input) {
+    ssize_t n;
+
+    while (link->len < NET_MSG_SIZE) {
+        n = recv(link->fd, link->msg + link->len, NET_MSG_SIZE - link->len, 0);
+        if (n > 0)
+            link->len += n;
+        else if (n < 0 && errno == EAGAIN)
+            return 0;
+        else if (n == 0 || errno != EINTR)
+            return -1;
+    }
+
+    *frame = link->msg[0] | link->msg[1] << 8 | link->msg[2] << 16 | (u32) link->msg[3] << 24;
+    *input = link->msg[4] | link->msg[5] << 8;
+    link->len = 0;
+    return 1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include "types.h"
+
+// Stream socket between the two sides of a versus game, a UNIX socket for
+// a path and TCP for host:port. Both sides are started with the same address:
+// the first one listens and plays as player 0, sending the seed to the one
+// that connects, which plays as player 1. After that every frame sends its
+// local input, with the frame number, little-endian:
+//   u32 frame, u16 input
+
+#define NET_MSG_SIZE 6
+#define NET_RETRIES 50        // connecting and listening both failed, the other side was starting too
+#define NET_RETRY_NS 100000000
+
+typedef struct Link {
+    int fd;
+    u8 msg[NET_MSG_SIZE];  // message being read
+    u8 len;                // its bytes read so far
+} Link;
+
+bool link_open(Link *link, const char *addr, u64 *seed, u8 *player);
+void link_close(Link *link);
+bool link_send(Link *link, u32 frame, u16 input);
+int link_recv(Link *link, u32 *frame, u16 *input);
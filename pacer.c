@@ -0,0 +1,76 @@
+#include <inttypes.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "pacer.h"
+
+#define FRAME_BUCKET_NS 250000 // up to 64 ms
+#define JITTER_BUCKET_NS 20000 // up to 5 ms
+
+bool pacer_init(Pacer *pacer, u32 rate) {
+    *pacer = (Pacer) { .rate = rate };
+    hist_init(&pacer->frame_time, FRAME_BUCKET_NS);
+    hist_init(&pacer->jitter, JITTER_BUCKET_NS);
+    pacer_reset(pacer);
+
+    pacer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return pacer->fd >= 0;
+}
+
+void pacer_close(Pacer *pacer) {
+    close(pacer->fd);
+}
+
+// Starts a new schedule from now, e.g. after the game was paused
+void pacer_reset(Pacer *pacer) {
+    pacer->origin = now_ns();
+    pacer->index = 0;
+    pacer->frame_start = pacer->origin;
+}
+
+// Deadline of a frame; computed from the origin so that rounding never accumulates
+static u64 deadline(Pacer *pacer, u64 index) {
+    return pacer->origin + index * 1000000000 / pacer->rate;
+}
+
+// Sets the timer to the start of the next frame
+void pacer_arm(Pacer *pacer) {
+    u64 period = 1000000000 / pacer->rate;
+    u64 now = now_ns();
+    struct itimerspec its = { 0 };
+
+    pacer->next = deadline(pacer, ++pacer->index);
+    pacer->slack = pacer->next > now ? pacer->next - now : 0;
+    if (now >= pacer->next + period * PACER_CATCH_UP) {
+        // too far behind, the missed frames are dropped instead of rushed through
+        pacer->skipped += (now - pacer->next) / period;
+        pacer->origin = now;
+        pacer->index = 0;
+        pacer->next = now;
+    } else if (now >= pacer->next) {
+        pacer->late++; // slightly behind, the timer fires right away to catch up
+    }
+
+    its.it_value.tv_sec = pacer->next / 1000000000;
+    its.it_value.tv_nsec = pacer->next % 1000000000;
+    timerfd_settime(pacer->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Marks the start of a frame once the timer fired
+void pacer_fired(Pacer *pacer) {
+    u64 expirations, now = now_ns();
+
+    if (read(pacer->fd, &expirations, sizeof(expirations)) < 0)
+        expirations = 0;
+
+    hist_add(&pacer->jitter, now > pacer->next ? now - pacer->next : 0);
+    hist_add(&pacer->frame_time, now - pacer->frame_start);
+    pacer->frame_start = now;
+    pacer->frames++;
+}
+
+void pacer_dump(Pacer *pacer, FILE *file) {
+    fprintf(file, "frames: %" PRIu64 ", late %" PRIu64 ", skipped %" PRIu64 "\n", pacer->frames,
+            pacer->late, pacer->skipped);
+    hist_dump(&pacer->frame_time, file, "frame time");
+    hist_dump(&pacer->jitter, file, "jitter");
+}
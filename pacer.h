@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "stats.h"
+
+#define PACER_CATCH_UP 3 // late frames run back to back, further behind they are skipped
+
+// Frame scheduler firing a timerfd at absolute deadlines of the monotonic clock,
+// so the caller can wait for input and the next frame together
+typedef struct Pacer {
+    int fd;          // readable when the next frame is due
+    u32 rate;        // frames per second
+    u64 origin;      // start of the schedule
+    u64 index;       // frame number within the schedule
+    u64 next;        // deadline of the next frame
+    u64 slack;       // time left until it when the last frame finished
+    u64 frame_start;
+    u64 frames;
+    u64 late;        // frames started late without sleeping
+    u64 skipped;     // frames dropped from the schedule
+    Hist frame_time; // from the start of a frame to the start of the next one
+    Hist jitter;     // how long after its deadline a frame started
+} Pacer;
+
+bool pacer_init(Pacer *pacer, u32 rate);
+void pacer_close(Pacer *pacer);
+void pacer_reset(Pacer *pacer);
+void pacer_arm(Pacer *pacer);
+void pacer_fired(Pacer *pacer);
+void pacer_dump(Pacer *pacer, FILE *file);
@@ -0,0 +1,174 @@
+#include <string.h>
+
+#include "pc.h"
+#include "tm_table.h"
+
+// Allocates the memo of a solver
+bool pc_init(PcSolver *pc) {
+    memset(pc, 0, sizeof(PcSolver));
+    return tt_init(&pc->memo, PC_TT_BITS);
+}
+
+void pc_free(PcSolver *pc) {
+    tt_free(&pc->memo);
+}
+
+// Writes the types of the field tetromino and of the ones the randomizer
+// will deal after it, returns their number
+u8 pc_queue(Game *game, u8 *queue, u8 max) {
+    Game copy = *game;
+    u8 num = 0;
+
+    if (game->tm_field.type != BLACK && num < max)
+        queue[num++] = game->tm_field.type;
+    if (num < max)
+        queue[num++] = game->tm_next.type;
+    while (num < max)
+        queue[num++] = tm_create_rand(&copy).type;
+
+    return num;
+}
+
+// Checks whether the empty cells of the lines left can still be covered
+// by the tetrominoes of the queue from an index on and the held one
+static bool feasible(PcSolver *pc, const u32 column[FIELD_X], u8 index, u8 hold, u8 lines) {
+    u16 empty, segment = 0, pieces = 0;
+    i16 parity = 0, reach = 0;
+    u8 type;
+
+    for (u8 x = 0; x <= FIELD_X; x++) {
+        empty = x < FIELD_X ? lines - __builtin_popcount(column[x]) : 0;
+        if (empty == 0) {
+            // a full column is a wall that no tetromino crosses, even once lines clear
+            if (segment % 4 != 0)
+                return false;
+            segment = 0;
+        }
+        segment += empty;
+        pieces += empty;
+        parity += x % 2 == 0 ? empty : -empty;
+    }
+
+    pieces /= 4;
+    if (pieces > pc->queue_num - index)
+        return false;
+
+    // the tetrominoes placed are all but one of the queue ones the placements
+    // take and the held one; I can even out 4 cells, L and J always 2, T 2 or none
+    for (u8 i = 0; i <= pieces; i++) {
+        if (i == pieces && hold != BLACK)
+            type = hold;
+        else
+            type = index + i < pc->queue_num ? pc->queue[index + i] : BLACK;
+        if (type == TM_I)
+            reach += 4;
+        else if (type == TM_L || type == TM_J || type == TM_T)
+            reach += 2;
+    }
+
+    return parity <= reach && -parity <= reach;
+}
+
+// Adds the placements of a tetromino inside the lines left, returns
+// the new number of moves
+static u16 add_moves(PcSolver *pc, const u32 column[FIELD_X], u8 type, u8 lines, Tetromino *move, u16 num) {
+    Tetromino start = { .type = type, .orientation = 0, .pos = { 0, TM_SHAPE[type][0].spawn_x } };
+    u16 places;
+
+    memcpy(pc->game.column, column, sizeof(pc->game.column));
+    places = find_placements(&pc->ps, &pc->game, &start);
+    for (u16 i = 0; i < places; i++)
+        if (pc->ps.place[i].pos.y + TM_SHAPE[type][pc->ps.place[i].orientation].bbox.top >= FIELD_Y - lines)
+            move[num++] = pc->ps.place[i];
+
+    return num;
+}
+
+// Searches for a perfect clear of the lines left on a board with the queue
+// from an index on, recording its steps from a depth on
+static bool search(PcSolver *pc, const u32 column[FIELD_X], u64 hash, u8 index, u8 hold,
+                   bool can_hold, u8 lines, u8 depth) {
+    Tetromino *move = pc->move[depth];
+    u32 next[FIELD_X];
+    u64 key, next_hash, data;
+    u16 num, split;
+    u8 cur, cleared;
+
+    if (lines == 0) {
+        pc->step_num = depth;
+        return true;
+    }
+    if (pc->max_nodes != 0 && pc->nodes >= pc->max_nodes) {
+        pc->gave_up = true;
+        return false;
+    }
+    pc->nodes++;
+
+    if (!feasible(pc, column, index, hold, lines))
+        return false;
+    key = hash ^ pc->salt ^ ZOBRIST_HOLD[hold] ^ (u64) index << 56;
+    if (can_hold && tt_probe(&pc->memo, key, &data))
+        return false;
+
+    // placing the field tetromino, or the one a hold brings in
+    cur = pc->queue[index];
+    num = split = add_moves(pc, column, cur, lines, move, 0);
+    if (can_hold && hold != cur && (hold != BLACK || index + 1 < pc->queue_num))
+        num = add_moves(pc, column, hold != BLACK ? hold : pc->queue[index + 1], lines, move, num);
+
+    for (u16 i = 0; i < num; i++) {
+        memcpy(next, column, sizeof(next));
+        next_hash = hash;
+        cleared = placement_lock(next, &next_hash, &move[i]);
+        if (search(pc, next, next_hash, i < split || hold != BLACK ? index + 1 : index + 2,
+                   i < split ? hold : cur, true, lines - cleared, depth + 1)) {
+            pc->step[depth] = (PcStep) { move[i], i >= split, cur, hash };
+            return true;
+        }
+        if (pc->gave_up)
+            return false;
+    }
+
+    if (can_hold)
+        tt_store(&pc->memo, key, 0);
+    return false;
+}
+
+// Searches for a perfect clear of a game within max_pieces placements, with
+// the tetromino types of the queue starting with the field one
+PcResult pc_solve(PcSolver *pc, Game *game, const u8 *queue, u8 queue_num, u8 max_pieces) {
+    u64 hash = placement_hash(game->column);
+    u16 cells = 0, pieces;
+    u8 height = 0, lines;
+
+    pc->nodes = 0;
+    pc->gave_up = false;
+    pc->step_num = 0;
+    pc->queue_num = queue_num < PC_QUEUE_MAX ? queue_num : PC_QUEUE_MAX;
+    memcpy(pc->queue, queue, pc->queue_num);
+    if (max_pieces > PC_MAX_PIECES)
+        max_pieces = PC_MAX_PIECES;
+
+    for (u8 x = 0; x < FIELD_X; x++) {
+        cells += __builtin_popcount(game->column[x]);
+        if (game->column[x] != 0 && FIELD_Y - __builtin_ctz(game->column[x]) > height)
+            height = FIELD_Y - __builtin_ctz(game->column[x]);
+    }
+
+    for (lines = height > 0 ? height : 1; lines <= FIELD_Y; lines++) {
+        if ((10 * lines - cells) % 4 != 0)
+            continue;
+        pieces = (10 * lines - cells) / 4;
+        if (pieces > max_pieces || pieces > pc->queue_num)
+            break;
+
+        // keys of earlier searches, with other queues or lines, never match
+        pc->salt = ++pc->searches << 8 | lines;
+        if (search(pc, game->column, hash, 0, game->tm_hold.type, !game->swapped, lines, 0))
+            return PC_FOUND;
+        if (pc->gave_up)
+            return PC_GAVE_UP;
+    }
+
+    return PC_NONE;
+}
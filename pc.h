@@ -0,0 +1,57 @@
+#pragma once
+
+#include "game.h"
+#include "placement.h"
+#include "tt.h"
+
+// Perfect clear solver. Given a board, the queue of tetrominoes to come and
+// the held one, it searches for placements that end with an empty field.
+// A perfect clear of L lines takes (10L - cells) / 4 tetrominoes, so the
+// solver tries every line count whose tetromino count is whole and within
+// the limit, lowest first, keeping all the blocks in the lowest L rows like
+// other solvers do. The depth-first search over the reachable placements
+// drops positions that can't work out:
+//   - more tetrominoes are needed than the queue has left,
+//   - regions walled off by columns full up to the top of the lines left
+//     don't have a multiple of 4 empty cells,
+//   - the empty cells of even and odd columns differ by more than the
+//     tetrominoes left can make up (only I, L, J and T cover them unevenly),
+//   - the position has already failed (memoized by its Zobrist hash).
+
+#define PC_MAX_PIECES 16
+#define PC_QUEUE_MAX (PC_MAX_PIECES + 1)  // the pieces and the one a hold leaves
+#define PC_TT_BITS 18
+
+typedef enum PcResult {
+    PC_FOUND,
+    PC_NONE,      // proved there is none
+    PC_GAVE_UP,   // ran out of nodes
+} PcResult;
+
+typedef struct PcStep {
+    Tetromino place;  // resting position, locked with a hard drop
+    bool hold;        // the placed tetromino comes in by a hold
+    u8 piece;         // field tetromino before the step
+    u64 board;        // Zobrist hash of the board before the step
+} PcStep;
+
+typedef struct PcSolver {
+    PlaceSearch ps;
+    Game game;                      // board of the placement search
+    Tt memo;                        // positions without a solution
+    u64 salt;                       // tells apart the memo keys of every search
+    u64 searches;
+    u8 queue[PC_QUEUE_MAX];
+    u8 queue_num;
+    Tetromino move[PC_MAX_PIECES][2 * PLACE_MAX]; // placements of every depth
+    u64 nodes;                      // positions searched by the last solve
+    u64 max_nodes;                  // 0 for no limit
+    bool gave_up;
+    PcStep step[PC_MAX_PIECES];
+    u8 step_num;
+} PcSolver;
+
+bool pc_init(PcSolver *pc);
+void pc_free(PcSolver *pc);
+u8 pc_queue(Game *game, u8 *queue, u8 max);
+PcResult pc_solve(PcSolver *pc, Game *game, const u8 *queue, u8 queue_num, u8 max_pieces);
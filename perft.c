@@ -0,0 +1,262 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game.h"
+
+// Counts the distinct boards reachable after every number of placements
+// from the start of a seeded game, like perft does for chess move generators.
+// Placements are found with the engine's own rules: moves and soft drops
+// checked by tm_fits(), rotations with wall kicks by tm_rotate(), and locked
+// by a hard drop through tick(), which clears the lines. Holds are not used,
+// so every board of a depth has the same tetrominoes to come.
+// A change to any of these rules changes the counts in perft.ref.
+
+#define DEFAULT_DEPTH 3
+#define MAX_DEPTH 6
+#define MAX_LINE_LEN 256
+#define ROWS (FIELD_Y + TM_SIZE)  // origin rows, from -2 to FIELD_Y + 1
+#define COLS (FIELD_X + TM_SIZE)  // origin columns, from -2 to FIELD_X + 1
+#define ROW(y) ((y) + 2)
+#define COL(x) ((x) + 2)
+
+// Distinct boards of a depth, in an open addressing table of their hashes
+typedef struct Level {
+    u16 (*board)[FIELD_Y];
+    u64 *hash;
+    u32 *slot;     // board index + 1, 0 when empty
+    u32 num;
+    u32 cap;       // the table has 2 * cap slots
+} Level;
+
+typedef struct Perft {
+    Tetromino queue[TM_ORIENT * ROWS * COLS]; // breadth-first search of a tetromino
+    bool seen[TM_ORIENT][ROWS][COLS];
+    u64 nodes;                                // placements locked
+} Perft;
+
+static bool level_grow(Level *lv) {
+    u32 cap = lv->cap ? lv->cap * 2 : 1024;
+    u16 (*board)[FIELD_Y] = realloc(lv->board, cap * sizeof(*board));
+    u64 *hash = realloc(lv->hash, cap * sizeof(u64));
+    u32 *slot = calloc(2 * (u64) cap, sizeof(u32));
+
+    if (board != NULL)
+        lv->board = board;
+    if (hash != NULL)
+        lv->hash = hash;
+    if (board == NULL || hash == NULL || slot == NULL) {
+        free(slot);
+        return false;
+    }
+
+    free(lv->slot);
+    lv->slot = slot;
+    lv->cap = cap;
+    for (u32 i = 0; i < lv->num; i++) {
+        u32 s = lv->hash[i] & (2 * cap - 1);
+        while (lv->slot[s] != 0)
+            s = (s + 1) & (2 * cap - 1);
+        lv->slot[s] = i + 1;
+    }
+    return true;
+}
+
+// Adds the board of a game unless the level has it already
+static bool level_add(Level *lv, Game *game) {
+    u32 s, i;
+
+    if (lv->num == lv->cap && !level_grow(lv))
+        return false;
+
+    for (s = game->hash & (2 * lv->cap - 1); lv->slot[s] != 0; s = (s + 1) & (2 * lv->cap - 1)) {
+        i = lv->slot[s] - 1;
+        if (lv->hash[i] == game->hash && memcmp(lv->board[i], game->board, sizeof(game->board)) == 0)
+            return true;
+    }
+
+    memcpy(lv->board[lv->num], game->board, sizeof(game->board));
+    lv->hash[lv->num] = game->hash;
+    lv->slot[s] = ++lv->num;
+    return true;
+}
+
+static void level_free(Level *lv) {
+    free(lv->board);
+    free(lv->hash);
+    free(lv->slot);
+    *lv = (Level) { 0 };
+}
+
+// Queues a position of the field tetromino unless it has been seen
+static void visit(Perft *pf, u32 *num, Tetromino *tm) {
+    bool *seen = &pf->seen[tm->orientation][ROW(tm->pos.y)][COL(tm->pos.x)];
+
+    if (*seen)
+        return;
+    *seen = true;
+    pf->queue[(*num)++] = *tm;
+}
+
+// Locks the field tetromino of a game in every position it can reach,
+// adding the resulting boards to a level
+static bool expand(Perft *pf, Game *game, Level *next) {
+    static const Vec MOVES[] = { { 0, -1 }, { 0, 1 }, { 1, 0 } };
+    Tetromino tm, moved;
+    Game child;
+    u32 num = 0;
+
+    memset(pf->seen, 0, sizeof(pf->seen));
+    visit(pf, &num, &game->tm_field);
+
+    for (u32 n = 0; n < num; n++) {
+        tm = pf->queue[n];
+        for (u8 m = 0; m < sizeof(MOVES) / sizeof(MOVES[0]); m++) {
+            if (!tm_fits(game, &tm, MOVES[m]))
+                continue;
+            moved = tm;
+            moved.pos.y += MOVES[m].y;
+            moved.pos.x += MOVES[m].x;
+            visit(pf, &num, &moved);
+        }
+        for (u8 cw = 0; cw < 2; cw++) {
+            game->tm_field = tm;
+            game->floor_counter = FLOOR_MOVES;
+            tm_rotate(game, cw);
+            visit(pf, &num, &game->tm_field);
+        }
+
+        if (!tm_on_floor(game, &tm))
+            continue;
+        child = *game;
+        child.tm_field = tm;
+        tick(&child, IN_HARD_DROP);
+        pf->nodes++;
+        if (!level_add(next, &child))
+            return false;
+    }
+
+    return true;
+}
+
+// Counts the boards of every depth up to a given one, returns false
+// when out of memory
+static bool perft(Perft *pf, u64 seed, u8 depth, u64 count[MAX_DEPTH + 1]) {
+    Level level[2] = { 0 };
+    Game game, start;
+    bool ok = true;
+
+    game_init(&start, seed);
+    ok = level_add(&level[0], &start);
+    count[0] = 1;
+
+    for (u8 d = 1; d <= depth && ok; d++) {
+        Level *cur = &level[(d - 1) % 2], *next = &level[d % 2];
+
+        next->num = 0;
+        if (next->slot != NULL)
+            memset(next->slot, 0, 2 * (u64) next->cap * sizeof(u32));
+
+        for (u32 b = 0; b < cur->num && ok; b++) {
+            game = start;
+            memcpy(game.board, cur->board[b], sizeof(game.board));
+            update_columns(&game);
+            if (tm_fits(&game, &game.tm_field, (Vec) { 0, 0 }))
+                ok = expand(pf, &game, next);
+        }
+        count[d] = next->num;
+
+        // the next tetromino spawns the same way on every board
+        tm_spawn(&start);
+    }
+
+    level_free(&level[0]);
+    level_free(&level[1]);
+    return ok;
+}
+
+// Checks the counts of a reference file, lines of "seed depth boards"
+static bool check(Perft *pf, const char *path, u32 *failed) {
+    char line[MAX_LINE_LEN];
+    u64 seed, boards, count[MAX_DEPTH + 1];
+    unsigned depth;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%" SCNu64 " %u %" SCNu64, &seed, &depth, &boards) != 3 || depth > MAX_DEPTH) {
+            fprintf(stderr, "%s: invalid line '%s'\n", path, line);
+            fclose(file);
+            return false;
+        }
+        if (!perft(pf, seed, depth, count)) {
+            fprintf(stderr, "out of memory\n");
+            fclose(file);
+            return false;
+        }
+
+        printf("seed %" PRIu64 " depth %u: %" PRIu64 " boards, expected %" PRIu64 "%s\n",
+               seed, depth, count[depth], boards, count[depth] == boards ? "" : " MISMATCH");
+        *failed += count[depth] != boards;
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s seed] [-d depth]\n"
+                    "       %s -c reference\n", name, name);
+}
+
+int main(int argc, char **argv) {
+    static Perft pf;
+    const char *ref_path = NULL;
+    u64 seed = 1, count[MAX_DEPTH + 1];
+    u8 depth = DEFAULT_DEPTH;
+    u32 failed = 0;
+    struct timespec start, end;
+    f64 elapsed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:d:c:h")) != -1) {
+        switch (opt) {
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'd': depth = strtoul(optarg, NULL, 10); break;
+            case 'c': ref_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (depth > MAX_DEPTH) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (ref_path != NULL) {
+        if (!check(&pf, ref_path, &failed))
+            return 1;
+    } else {
+        if (!perft(&pf, seed, depth, count)) {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            return 1;
+        }
+        for (u8 d = 1; d <= depth; d++)
+            printf("%" PRIu64 " %u %" PRIu64 "\n", seed, d, count[d]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9;
+
+    printf("nodes:   %" PRIu64 "\n", pf.nodes);
+    printf("time:    %.3f s\n", elapsed);
+    printf("nodes/s: %.0f\n", pf.nodes / elapsed);
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,277 @@
+#include <string.h>
+
+#include "placement.h"
+
+// Checks whether a tetromino orientation fits in a given position
+inline static bool fits(PlaceSearch *ps, u8 orientation, i16 y, i16 x) {
+    return !(ps->blocked[orientation][PLACE_COL(x)] & (1u << PLACE_ROW_BIT(y)));
+}
+
+// Computes the rows every orientation of a tetromino type doesn't fit in,
+// shifting the board columns under each of its blocks
+static void block_rows(PlaceSearch *ps, Game *game, u8 type) {
+    const TmShape *shape;
+    u32 bounds, rows;
+
+    for (u8 o = 0; o < TM_ORIENT; o++) {
+        shape = &TM_SHAPE[type][o];
+        for (u8 i = 0; i < PLACE_COLS; i++)
+            ps->blocked[o][i] = ~0u;
+
+        // rows under the floor and above the top of the field
+        bounds = ~0u << PLACE_ROW_BIT(FIELD_Y - shape->bbox.bottom);
+        bounds |= (1u << PLACE_ROW_BIT(-shape->bbox.top)) - 1;
+        for (i16 x = -shape->bbox.left; x + shape->bbox.right < FIELD_X; x++) {
+            rows = bounds;
+            for (u8 b = 0; b < TM_SIZE; b++)
+                rows |= game->column[x + shape->block[b].x] << PLACE_ROW_BIT(0) >> shape->block[b].y;
+            ps->blocked[o][PLACE_COL(x)] = rows;
+        }
+    }
+}
+
+// Extends a set of rows by all the free rows under them they can fall to
+inline static u32 fall(u32 rows, u32 free) {
+    rows |= (rows << 1) & free;
+    free &= free << 1;
+    rows |= (rows << 2) & free;
+    free &= free << 2;
+    rows |= (rows << 4) & free;
+    free &= free << 4;
+    rows |= (rows << 8) & free;
+    free &= free << 8;
+    rows |= (rows << 16) & free;
+    return rows;
+}
+
+// Marks free rows of a column as reached, queueing it when some are new
+inline static void reach(PlaceSearch *ps, u8 orientation, u8 col, u32 rows) {
+    rows = fall(rows, ~ps->blocked[orientation][col]);
+    if (rows & ~ps->reached[orientation][col]) {
+        ps->reached[orientation][col] |= rows;
+        ps->queued[orientation] |= 1u << col;
+    }
+}
+
+// Rotates the reached rows of a column, every row taking the first position
+// that fits out of the rotation in place and its wall kicks
+static void rotate_rows(PlaceSearch *ps, u8 type, u8 orientation, u8 col, bool clockwise) {
+    u8 o = (orientation + (clockwise ? 1 : TM_ORIENT - 1)) % TM_ORIENT;
+    const Vec *kick = (type != TM_I ? WALL_KICK : WALL_KICK_I)[clockwise ? 0 : 1][o];
+    u32 rows = ps->reached[orientation][col], free, moved;
+    Vec offset;
+
+    for (u8 i = 0; i <= WK_TESTS && rows != 0; i++) {
+        offset = i == 0 ? (Vec) { 0, 0 } : kick[i - 1];
+        free = ~ps->blocked[o][col + offset.x];
+        if (offset.y >= 0) {
+            moved = rows & (free >> offset.y);
+            reach(ps, o, col + offset.x, moved << offset.y);
+        } else {
+            moved = rows & (free << -offset.y);
+            reach(ps, o, col + offset.x, moved >> -offset.y);
+        }
+        rows &= ~moved;
+    }
+}
+
+// Index of the cells a resting tetromino covers: orientations that cover
+// the same cells (O ones, or the opposite S, Z and I ones) share a class
+static u16 place_index(Tetromino *tm) {
+    const BoundingBox *bbox = &TM_SHAPE[tm->type][tm->orientation].bbox;
+    u8 class = tm->orientation;
+
+    if (tm->type == TM_O)
+        class = 0;
+    else if (tm->type == TM_S || tm->type == TM_Z || tm->type == TM_I)
+        class &= 1;
+
+    return (class * FIELD_Y + tm->pos.y + bbox->top) * FIELD_X + tm->pos.x + bbox->left;
+}
+
+// Finds every final placement of a tetromino reachable from its position,
+// returns their number
+u16 find_placements(PlaceSearch *ps, Game *game, Tetromino *tm) {
+    u8 o, col;
+    u32 landed;
+    Tetromino place;
+    u16 index;
+
+    ps->start = *tm;
+    ps->place_num = 0;
+    memset(ps->found, 0, sizeof(ps->found));
+    if (tm->type == BLACK)
+        return 0;
+    block_rows(ps, game, tm->type);
+    if (!fits(ps, tm->orientation, tm->pos.y, tm->pos.x))
+        return 0;
+
+    memset(ps->reached, 0, sizeof(ps->reached));
+    memset(ps->queued, 0, sizeof(ps->queued));
+    reach(ps, tm->orientation, PLACE_COL(tm->pos.x), 1u << PLACE_ROW_BIT(tm->pos.y));
+
+    // rotations queue the other orientations, so they are expanded in turns
+    for (o = tm->orientation; ps->queued[0] | ps->queued[1] | ps->queued[2] | ps->queued[3];
+         o = (o + 1) % TM_ORIENT) {
+        while (ps->queued[o] != 0) {
+            col = __builtin_ctz(ps->queued[o]);
+            ps->queued[o] &= ps->queued[o] - 1;
+
+            reach(ps, o, col - 1, ps->reached[o][col] & ~ps->blocked[o][col - 1]);
+            reach(ps, o, col + 1, ps->reached[o][col] & ~ps->blocked[o][col + 1]);
+            if (tm->type != TM_O) {
+                rotate_rows(ps, tm->type, o, col, true);
+                rotate_rows(ps, tm->type, o, col, false);
+            }
+        }
+    }
+
+    for (o = 0; o < TM_ORIENT; o++) {
+        for (col = 0; col < PLACE_COLS; col++) {
+            landed = ps->reached[o][col] & (ps->blocked[o][col] >> 1);
+            for (; landed != 0; landed &= landed - 1) {
+                place = (Tetromino) { tm->type, o,
+                    { __builtin_ctz(landed) - PLACE_ROW_BIT(0), col - PLACE_COL(0) } };
+                index = place_index(&place);
+                if (ps->found[index / 64] & (1ull << (index % 64)))
+                    continue;
+                ps->found[index / 64] |= 1ull << (index % 64);
+                ps->place[ps->place_num++] = place;
+            }
+        }
+    }
+
+    return ps->place_num;
+}
+
+// Index of the placement of the last search covering the same cells
+// as a resting tetromino, the number of placements if there is none
+u16 placement_find(PlaceSearch *ps, Tetromino *tm) {
+    u16 index = place_index(tm);
+
+    if (tm->type != ps->start.type || !(ps->found[index / 64] & (1ull << (index % 64))))
+        return ps->place_num;
+    for (u16 i = 0; i < ps->place_num; i++)
+        if (place_index(&ps->place[i]) == index)
+            return i;
+
+    return ps->place_num;
+}
+
+// Rotates a tetromino the way tm_rotate does, trying the wall kicks
+// when it doesn't fit in place; returns false when none of the positions fit
+static bool rotate(PlaceSearch *ps, Tetromino *tm, bool clockwise) {
+    u8 o = (tm->orientation + (clockwise ? 1 : TM_ORIENT - 1)) % TM_ORIENT;
+    const Vec *kick = (tm->type != TM_I ? WALL_KICK : WALL_KICK_I)[clockwise ? 0 : 1][o];
+    Vec offset;
+
+    for (u8 i = 0; i <= WK_TESTS; i++) {
+        offset = i == 0 ? (Vec) { 0, 0 } : kick[i - 1];
+        if (fits(ps, o, tm->pos.y + offset.y, tm->pos.x + offset.x)) {
+            tm->orientation = o;
+            tm->pos.y += offset.y;
+            tm->pos.x += offset.x;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Queues a state of the path search unless it has been visited already
+static void visit(PlaceSearch *ps, Tetromino *tm, u16 parent, u8 input) {
+    u32 *visited = &ps->reached[tm->orientation][PLACE_COL(tm->pos.x)];
+    u32 row = 1u << PLACE_ROW_BIT(tm->pos.y);
+
+    if (*visited & row)
+        return;
+    *visited |= row;
+    ps->node[ps->node_num++] = (PlaceNode) { *tm, parent, input };
+}
+
+// Writes the shortest input sequence reaching a placement of the last search,
+// ended by the locking hard drop; returns its length or 0 if it doesn't fit
+// in max. The placements of the search stay valid.
+u8 placement_path(PlaceSearch *ps, u16 index, u8 *path, u8 max) {
+    static const u8 INPUTS[] = { IN_MV_LEFT, IN_MV_RIGHT, IN_ROTATE_CW, IN_ROTATE_CCW, IN_SOFT_DROP };
+    Tetromino *target = &ps->place[index], cur, next;
+    u16 n, m, len;
+
+    memset(ps->reached, 0, sizeof(ps->reached));
+    ps->node_num = 0;
+    visit(ps, &ps->start, 0, IN_NONE);
+
+    for (n = 0; n < ps->node_num; n++) {
+        cur = ps->node[n].tm;
+        if (cur.orientation == target->orientation &&
+            cur.pos.x == target->pos.x && cur.pos.y == target->pos.y)
+            break;
+
+        for (u8 i = 0; i < sizeof(INPUTS); i++) {
+            next = cur;
+            switch (INPUTS[i]) {
+                case IN_MV_LEFT:   next.pos.x--; break;
+                case IN_MV_RIGHT:  next.pos.x++; break;
+                case IN_SOFT_DROP: next.pos.y++; break;
+                default:
+                    if (cur.type == TM_O || !rotate(ps, &next, INPUTS[i] == IN_ROTATE_CW))
+                        continue;
+            }
+            if (fits(ps, next.orientation, next.pos.y, next.pos.x))
+                visit(ps, &next, n, INPUTS[i]);
+        }
+    }
+    if (n == ps->node_num)
+        return 0;
+
+    len = 1;
+    for (m = n; m != 0; m = ps->node[m].parent)
+        len++;
+    if (len > max)
+        return 0;
+
+    path[len - 1] = IN_HARD_DROP;
+    for (m = n, index = len - 1; m != 0; m = ps->node[m].parent)
+        path[--index] = ps->node[m].input;
+
+    return len;
+}
+
+// Zobrist hash of a board from its columns
+u64 placement_hash(const u32 column[FIELD_X]) {
+    u64 hash = 0;
+
+    for (u8 x = 0; x < FIELD_X; x++)
+        for (u32 rows = column[x]; rows != 0; rows &= rows - 1)
+            hash ^= ZOBRIST_CELL[__builtin_ctz(rows)][x];
+    return hash;
+}
+
+// Locks a resting tetromino onto a board given by its columns and clears
+// the full rows, keeping the hash of the board; returns the cleared lines
+u8 placement_lock(u32 column[FIELD_X], u64 *hash, Tetromino *tm) {
+    const TmShape *shape = &TM_SHAPE[tm->type][tm->orientation];
+    u32 full = ~0u;
+    u8 lines, line;
+    Vec block;
+
+    for (u8 b = 0; b < TM_SIZE; b++) {
+        block = (Vec) { tm->pos.y + shape->block[b].y, tm->pos.x + shape->block[b].x };
+        column[block.x] |= 1u << block.y;
+        *hash ^= ZOBRIST_CELL[block.y][block.x];
+    }
+    for (u8 x = 0; x < FIELD_X; x++)
+        full &= column[x];
+    if (full == 0)
+        return 0;
+
+    lines = __builtin_popcount(full);
+    for (; full != 0; full &= full - 1) {
+        line = __builtin_ctz(full);
+        for (u8 x = 0; x < FIELD_X; x++)
+            column[x] = (column[x] & ~((2u << line) - 1)) | ((column[x] & ((1u << line) - 1)) << 1);
+    }
+    *hash = placement_hash(column);
+
+    return lines;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "game.h"
+#include "tm_table.h"
+
+// Final placements reachable by a tetromino from its position through moves,
+// soft drops and rotations with wall kicks. The search is a breadth-first one
+// over (x, y, orientation) states that expands all the rows of a column at
+// once: every orientation and column keeps a bitset of the reached origin
+// rows. The input sequence (one input per tick) of a placement is found on
+// request by a second search that keeps the parents of the states.
+// The lock delay move limit and gravity are not modelled and holding is left
+// to the caller, which can search the held tetromino as well.
+
+#define PLACE_ROWS (FIELD_Y + TM_SIZE - 1) // origin rows, from -(TM_SIZE - 1)
+#define PLACE_STATES (TM_ORIENT * PLACE_ROWS * TM_COLS)
+#define PLACE_MAX (TM_ORIENT * FIELD_Y * FIELD_X) // distinct resting positions bound
+#define PLACE_KICK 2 // rows and columns a wall kick can move a tetromino by
+#define PLACE_COLS (TM_COLS + 2 * PLACE_KICK)
+#define PLACE_COL(x) (TM_COL(x) + PLACE_KICK)
+#define PLACE_ROW_BIT(y) ((y) + TM_SIZE - 1 + PLACE_KICK)
+
+typedef struct PlaceNode {
+    Tetromino tm;
+    u16 parent;
+    u8 input;  // input leading from the parent state
+} PlaceNode;
+
+// Search state, reused by every call so a search does not allocate.
+// Row sets have bit PLACE_ROW_BIT(y) set for the origin row y and are padded
+// by the kick reach on all sides, so kick tests need no bounds checks.
+typedef struct PlaceSearch {
+    Tetromino start;
+    u32 blocked[TM_ORIENT][PLACE_COLS];  // origin rows that don't fit
+    u32 reached[TM_ORIENT][PLACE_COLS];  // visited rows of the path search too
+    u32 queued[TM_ORIENT];               // columns with rows to expand
+    Tetromino place[PLACE_MAX];          // resting positions, before the locking hard drop
+    u16 place_num;
+    u64 found[(PLACE_MAX + 63) / 64];
+    PlaceNode node[PLACE_STATES];
+    u16 node_num;
+} PlaceSearch;
+
+u16 find_placements(PlaceSearch *ps, Game *game, Tetromino *tm);
+u16 placement_find(PlaceSearch *ps, Tetromino *tm);
+u8 placement_path(PlaceSearch *ps, u16 index, u8 *path, u8 max);
+u64 placement_hash(const u32 column[FIELD_X]);
+u8 placement_lock(u32 column[FIELD_X], u64 *hash, Tetromino *tm);
@@ -0,0 +1,218 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "pool.h"
+
+// Work-stealing thread pool. Every worker owns a range of task indices,
+// takes tasks from its front and, once it runs dry, steals the back half
+// of the range of another worker.
+
+typedef struct Deque {
+    pthread_mutex_t lock;
+    u32 front;
+    u32 back;
+} Deque;
+
+typedef struct Worker {
+    Pool *pool;
+    u32 id;
+    pthread_t thread;
+} Worker;
+
+struct Pool {
+    u32 workers;
+    Worker *worker;
+    Deque *deque;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    u64 generation;
+    u32 active;
+    bool quit;
+
+    PoolTask fn;
+    void *ctx;
+};
+
+// Takes a task from the front of a worker's own range
+static bool deque_pop(Deque *dq, u32 *task) {
+    bool found = false;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->front < dq->back) {
+        *task = dq->front++;
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    return found;
+}
+
+// Moves the back half of the victim's range into the thief's range
+static bool deque_steal(Deque *thief, Deque *victim) {
+    u32 front, back;
+
+    pthread_mutex_lock(&victim->lock);
+    back = victim->back;
+    front = back - (back - victim->front) / 2;
+    if (front == back && victim->front < back)
+        front--; // last remaining task
+    victim->back = front;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (front == back)
+        return false;
+
+    pthread_mutex_lock(&thief->lock);
+    thief->front = front;
+    thief->back = back;
+    pthread_mutex_unlock(&thief->lock);
+
+    return true;
+}
+
+// Runs tasks until there are none left in any of the ranges
+static void pool_work(Pool *pool, u32 id) {
+    Deque *own = &pool->deque[id];
+    bool stolen;
+    u32 task;
+
+    for (;;) {
+        while (deque_pop(own, &task))
+            pool->fn(pool->ctx, task, id);
+
+        stolen = false;
+        for (u32 i = 1; i < pool->workers && !stolen; i++)
+            stolen = deque_steal(own, &pool->deque[(id + i) % pool->workers]);
+
+        if (!stolen)
+            return;
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+    u64 generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == generation && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+            break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_work(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// Creates a pool of workers, the thread calling pool_run() being one of them
+Pool *pool_create(u32 workers) {
+    Pool *pool = calloc(1, sizeof(Pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->workers = workers > 0 ? workers : 1;
+    pool->worker = calloc(pool->workers, sizeof(Worker));
+    pool->deque = calloc(pool->workers, sizeof(Deque));
+    if (pool->worker == NULL || pool->deque == NULL) {
+        free(pool->worker);
+        free(pool->deque);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (u32 i = 0; i < pool->workers; i++) {
+        pthread_mutex_init(&pool->deque[i].lock, NULL);
+        pool->worker[i] = (Worker) { .pool = pool, .id = i };
+    }
+
+    // worker 0 is the calling thread
+    for (u32 i = 1; i < pool->workers; i++) {
+        if (pthread_create(&pool->worker[i].thread, NULL, worker_main, &pool->worker[i]) != 0) {
+            pool->workers = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+u32 pool_workers(Pool *pool) {
+    return pool->workers;
+}
+
+// Runs tasks 0 to tasks - 1 on all workers and waits for them to finish
+void pool_run(Pool *pool, u32 tasks, PoolTask fn, void *ctx) {
+    for (u32 i = 0; i < pool->workers; i++) {
+        pool->deque[i].front = (u64) tasks * i / pool->workers;
+        pool->deque[i].back = (u64) tasks * (i + 1) / pool->workers;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->active = pool->workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active != 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (u32 i = 1; i < pool->workers; i++)
+        pthread_join(pool->worker[i].thread, NULL);
+
+    for (u32 i = 0; i < pool->workers; i++)
+        pthread_mutex_destroy(&pool->deque[i].lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->worker);
+    free(pool->deque);
+    free(pool);
+}
+
+// Number of online processors
+u32 cpu_count() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (u32) n : 1;
+}
+
+// Raises the limit of open files as far as allowed, for a file per connection
+void raise_fd_limit() {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
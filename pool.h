@@ -0,0 +1,15 @@
+#pragma once
+
+#include "types.h"
+
+// Runs a single task; worker is the index of the thread running it
+typedef void (*PoolTask)(void *ctx, u32 task, u32 worker);
+
+typedef struct Pool Pool;
+
+Pool *pool_create(u32 workers);
+u32 pool_workers(Pool *pool);
+void pool_run(Pool *pool, u32 tasks, PoolTask fn, void *ctx);
+void pool_destroy(Pool *pool);
+u32 cpu_count();
+void raise_fd_limit();
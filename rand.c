@@ -0,0 +1,24 @@
+#include "rand.h"
+#include "game.h"
+
+// splitmix64
+u64 rand_next(u64 *state) {
+    u64 z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Returns the input of the random player for a frame
+u16 rand_input(u64 *state) {
+    static const u16 keys[] = {
+        IN_MV_LEFT, IN_MV_RIGHT, IN_ROTATE_CW, IN_ROTATE_CCW, IN_SOFT_DROP, IN_HOLD
+    };
+    u32 r = rand_next(state) % 100;
+
+    if (r < RAND_HARD_DROP)
+        return IN_HARD_DROP;
+    if (r < RAND_PRESS)
+        return keys[r % (sizeof(keys) / sizeof(keys[0]))];
+    return IN_NONE;
+}
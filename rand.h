@@ -0,0 +1,12 @@
+#pragma once
+
+#include "types.h"
+
+// Random player of tetris-sim and tetris-load: every frame it presses a key
+// with RAND_PRESS percent chance, a hard drop with RAND_HARD_DROP of those
+
+#define RAND_PRESS 20
+#define RAND_HARD_DROP 2
+
+u64 rand_next(u64 *state);
+u16 rand_input(u64 *state);
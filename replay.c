@@ -0,0 +1,278 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "replay.h"
+#include "snapshot.h"
+
+// Writes an unsigned LEB128 number
+static void put_var(FILE *file, u64 val) {
+    u8 byte;
+    do {
+        byte = val & 0x7f;
+        val >>= 7;
+        fputc(byte | (val != 0 ? 0x80 : 0), file);
+    } while (val != 0);
+}
+
+// Reads an unsigned LEB128 number, returns false when the data runs out
+static bool get_var(Replay *rp, u64 *val) {
+    u8 shift = 0;
+    *val = 0;
+
+    while (rp->pos < rp->size && shift < 64) {
+        u8 byte = rp->data[rp->pos++];
+        *val |= (u64) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+        shift += 7;
+    }
+
+    return false;
+}
+
+// Writes out the pending run of inputs
+static void rec_flush(Recorder *rec) {
+    if (rec->run == 0)
+        return;
+
+    fputc(REC_INPUT, rec->file);
+    put_var(rec->file, rec->run_frame - rec->last_frame);
+    put_var(rec->file, rec->run_input);
+    put_var(rec->file, rec->run);
+    rec->last_frame = rec->run_frame;
+    rec->run = 0;
+}
+
+// Creates a replay file and writes its header
+bool rec_open(Recorder *rec, const char *path, u64 seed, u32 keyframe_interval) {
+    *rec = (Recorder) { .keyframe_interval = keyframe_interval > 0 ? keyframe_interval : KEYFRAME_INTERVAL };
+    paint_init(&rec->paint);
+
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL)
+        return false;
+
+    fwrite(REPLAY_MAGIC, 1, 4, rec->file);
+    fputc(REPLAY_VERSION, rec->file);
+    for (u8 i = 0; i < 8; i++)
+        fputc((seed >> (i * 8)) & 0xff, rec->file);
+    put_var(rec->file, rec->keyframe_interval);
+
+    return true;
+}
+
+// Records the input of the next frame; call before passing it to tick()
+void rec_frame(Recorder *rec, const Game *game, u16 input) {
+    u8 state[SNAP_MAX];
+    size_t size;
+
+    // the game is the one after the tick of the previous frame
+    paint_update(&rec->paint, game);
+    if (rec->frame % rec->keyframe_interval == 0) {
+        rec_flush(rec);
+        size = snap_pack(game, &rec->paint, state);
+        fputc(REC_KEYFRAME, rec->file);
+        put_var(rec->file, rec->frame);
+        put_var(rec->file, size);
+        fwrite(state, size, 1, rec->file);
+        rec->last_frame = rec->frame;
+    }
+
+    if (input != IN_NONE) {
+        if (rec->run != 0 && input == rec->run_input && rec->run_frame + rec->run == rec->frame) {
+            rec->run++;
+        } else {
+            rec_flush(rec);
+            rec->run_frame = rec->frame;
+            rec->run_input = input;
+            rec->run = 1;
+        }
+    }
+
+    rec->frame++;
+}
+
+// Finishes the replay with the final result of the game
+bool rec_close(Recorder *rec, const Game *game) {
+    bool ok;
+
+    rec_flush(rec);
+    fputc(REC_END, rec->file);
+    put_var(rec->file, rec->frame);
+    put_var(rec->file, game->score);
+    put_var(rec->file, game->lines_cleared);
+
+    ok = !ferror(rec->file);
+    if (fclose(rec->file) != 0)
+        ok = false;
+    rec->file = NULL;
+    return ok;
+}
+
+// Reads the next record, returns false on the end record or broken data
+static bool replay_record(Replay *rp, RecordTag *tag) {
+    u64 a, b, c;
+
+    if (rp->pos >= rp->size)
+        return false;
+
+    *tag = rp->data[rp->pos++];
+    switch (*tag) {
+        case REC_INPUT:
+            if (!get_var(rp, &a) || !get_var(rp, &b) || !get_var(rp, &c))
+                return false;
+            rp->record_frame += a;
+            rp->run_frame = rp->record_frame;
+            rp->run_input = b;
+            rp->run = c;
+            return true;
+        case REC_KEYFRAME:
+            if (!get_var(rp, &a) || !get_var(rp, &b) || rp->size - rp->pos < b)
+                return false;
+            rp->record_frame = a;
+            rp->keyframe = rp->pos;
+            rp->keyframe_size = b;
+            rp->pos += b;
+            return true;
+        case REC_END:
+            if (!get_var(rp, &a) || !get_var(rp, &b) || !get_var(rp, &c))
+                return false;
+            rp->ended = true;
+            rp->end_frame = a;
+            rp->end_score = b;
+            rp->end_lines = c;
+            return false;
+    }
+
+    return false;
+}
+
+// Moves the reader to a record offset and resets the playback state
+static void replay_rewind(Replay *rp, size_t pos) {
+    rp->pos = pos;
+    rp->frame = 0;
+    rp->record_frame = 0;
+    rp->run_frame = 0;
+    rp->run = 0;
+}
+
+// Maps a replay file into memory and checks that it can be played back
+bool replay_open(Replay *rp, const char *path) {
+    struct stat st;
+    RecordTag tag;
+    u64 interval;
+    void *data;
+    int fd;
+
+    *rp = (Replay) { 0 };
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) < 0 || st.st_size < REPLAY_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    rp->data = data;
+    rp->size = st.st_size;
+
+    if (memcmp(rp->data, REPLAY_MAGIC, 4) != 0 || rp->data[4] != REPLAY_VERSION)
+        goto fail;
+    for (u8 i = 0; i < 8; i++)
+        rp->seed |= (u64) rp->data[5 + i] << (i * 8);
+    rp->pos = REPLAY_HEADER_SIZE;
+    if (!get_var(rp, &interval))
+        goto fail;
+    rp->keyframe_interval = interval;
+
+    // reading through the records once to validate them and find the end
+    rp->start = rp->pos;
+    while (replay_record(rp, &tag));
+    if (!rp->ended)
+        goto fail;
+
+    replay_rewind(rp, rp->start);
+    return true;
+
+fail:
+    replay_close(rp);
+    return false;
+}
+
+void replay_close(Replay *rp) {
+    if (rp->data != NULL)
+        munmap((void *) rp->data, rp->size);
+    rp->data = NULL;
+}
+
+// Returns the input of the next frame
+u16 replay_input(Replay *rp) {
+    RecordTag tag;
+    u64 frame = rp->frame++;
+
+    // reading records until a run that has not ended yet
+    while (frame >= rp->run_frame + rp->run && replay_record(rp, &tag));
+
+    if (frame >= rp->run_frame && frame < rp->run_frame + rp->run)
+        return rp->run_input;
+    return IN_NONE;
+}
+
+// Checks whether all of the recorded frames have been played
+bool replay_done(Replay *rp) {
+    return rp->frame >= rp->end_frame;
+}
+
+// Plays the replay up to a given frame, keeping the colors up to date
+// unless paint is NULL
+static void replay_play(Replay *rp, Game *game, Paint *paint, u64 frame) {
+    while (rp->frame < frame) {
+        tick(game, replay_input(rp));
+        if (paint != NULL)
+            paint_update(paint, game);
+    }
+}
+
+// Restores the last keyframe before a given frame and plays up to it,
+// along with the colors of the field unless paint is NULL
+bool replay_seek(Replay *rp, Game *game, Paint *paint, u64 frame) {
+    RecordTag tag;
+    size_t keyframe_pos = 0, state = 0;
+    u32 state_size = 0;
+    u64 keyframe = 0;
+
+    if (frame > rp->end_frame)
+        frame = rp->end_frame;
+
+    // finding the keyframe from the start of the records
+    replay_rewind(rp, rp->start);
+    while (replay_record(rp, &tag)) {
+        if (tag != REC_KEYFRAME)
+            continue;
+        if (rp->record_frame > frame)
+            break;
+        keyframe = rp->record_frame;
+        keyframe_pos = rp->pos;
+        state = rp->keyframe;
+        state_size = rp->keyframe_size;
+    }
+    if (keyframe_pos == 0 || snap_unpack(game, paint, rp->data + state, state_size) != state_size) {
+        replay_rewind(rp, rp->start);
+        return false;
+    }
+
+    replay_rewind(rp, keyframe_pos);
+    rp->frame = keyframe;
+    rp->record_frame = keyframe;
+    rp->run_frame = keyframe;
+    replay_play(rp, game, paint, frame);
+
+    return true;
+}
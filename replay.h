@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "game.h"
+
+// Replay file layout (integers are little-endian, "var" ones LEB128):
+//   header:   "NCTR", u8 version, u64 seed, var keyframe interval
+//   REC_INPUT:    var frames since the previous record, var input, var run length
+//   REC_KEYFRAME: var frame, var size, the packed Game state before that frame's tick
+//   REC_END:      var number of frames, var score, var lines cleared
+
+#define REPLAY_MAGIC "NCTR"
+#define REPLAY_VERSION 2
+#define REPLAY_HEADER_SIZE 13 // fixed part of the header
+#define KEYFRAME_INTERVAL (FRAMERATE * 10)
+
+typedef enum RecordTag {
+    REC_END = 0, REC_INPUT, REC_KEYFRAME
+} RecordTag;
+
+typedef struct Recorder {
+    FILE *file;
+    Paint paint;     // colors of the recorded game, for the keyframes
+    u32 keyframe_interval;
+    u64 frame;
+    u64 last_frame;  // frame of the last written record
+    u64 run_frame;   // first frame of the pending run
+    u32 run;         // number of frames in the pending run
+    u16 run_input;
+} Recorder;
+
+typedef struct Replay {
+    const u8 *data;
+    size_t size;
+    size_t pos;
+    size_t start;     // offset of the first record
+    u64 seed;
+    u32 keyframe_interval;
+    size_t keyframe;  // offset of the state of the last read keyframe
+    u32 keyframe_size;
+    u64 frame;
+    u64 record_frame; // frame of the last read record
+    u64 run_frame;
+    u32 run;
+    u16 run_input;
+    bool ended;
+    u64 end_frame;
+    u32 end_score;
+    u32 end_lines;
+} Replay;
+
+bool rec_open(Recorder *rec, const char *path, u64 seed, u32 keyframe_interval);
+void rec_frame(Recorder *rec, const Game *game, u16 input);
+bool rec_close(Recorder *rec, const Game *game);
+
+bool replay_open(Replay *rp, const char *path);
+void replay_close(Replay *rp);
+u16 replay_input(Replay *rp);
+bool replay_done(Replay *rp);
+bool replay_seek(Replay *rp, Game *game, Paint *paint, u64 frame);
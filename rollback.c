@@ -0,0 +1,69 @@
+#include "rollback.h"
+
+void rb_init(Rollback *rb, u64 seed, u8 local) {
+    *rb = (Rollback) { .local = local, .rewind = RB_NONE };
+    versus_init(&rb->vs, seed);
+}
+
+// Whether the next frame can be played without falling further behind the
+// remote inputs, always when they arrived ahead of it
+bool rb_ready(const Rollback *rb) {
+    return rb->frame < rb->confirmed || rb->frame - rb->confirmed < RB_WINDOW;
+}
+
+// Plays the next frame with a local input
+void rb_advance(Rollback *rb, u16 input) {
+    u16 *in = rb->input[rb->frame % RB_FRAMES];
+
+    in[rb->local] = input;
+    if (rb->frame >= rb->confirmed) // else it arrived ahead of the frame
+        in[!rb->local] = rb->last & RB_HELD;
+
+    rb->saved[rb->frame % RB_FRAMES] = rb->vs;
+    versus_tick(&rb->vs, in);
+    rb->frame++;
+}
+
+// Takes the remote input of a frame, they have to come in order and at most
+// RB_FRAMES - RB_WINDOW frames ahead; returns false for others
+bool rb_remote(Rollback *rb, u32 frame, u16 input) {
+    u16 *in = &rb->input[frame % RB_FRAMES][!rb->local];
+
+    if (frame != rb->confirmed || frame >= rb->frame + RB_FRAMES - RB_WINDOW)
+        return false;
+
+    // they come in order, so the first wrong prediction is the earliest one
+    if (frame < rb->frame && *in != input && rb->rewind == RB_NONE)
+        rb->rewind = frame;
+    *in = input;
+    rb->last = input;
+    rb->confirmed++;
+    return true;
+}
+
+// Plays the frames since the first wrong prediction again,
+// returns their number
+u32 rb_sync(Rollback *rb) {
+    u32 num;
+
+    if (rb->rewind == RB_NONE)
+        return 0;
+
+    rb->vs = rb->saved[rb->rewind % RB_FRAMES];
+    for (u32 f = rb->rewind; f < rb->frame; f++) {
+        rb->saved[f % RB_FRAMES] = rb->vs;
+        versus_tick(&rb->vs, rb->input[f % RB_FRAMES]);
+    }
+
+    num = rb->frame - rb->rewind;
+    rb->rollbacks++;
+    rb->replayed += num;
+    rb->rewind = RB_NONE;
+    return num;
+}
+
+// Whether the game ended on a frame both inputs are known for,
+// so no late input can change its result
+bool rb_over(const Rollback *rb) {
+    return rb->vs.lost != 0 && rb->rewind == RB_NONE && rb->vs.frame <= rb->confirmed;
+}
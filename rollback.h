@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include "versus.h"
+
+// Rollback of a versus game played over a network. Only inputs cross it:
+// every frame is played at once with the local input and a prediction of
+// the remote one, and the state before it is saved. When a remote input
+// arrives and differs from its prediction, the state before that frame is
+// restored and the frames since are played again with the inputs known by
+// then. The remote player is predicted to keep holding soft drop, the only
+// input repeated every frame while held, and to press nothing else.
+// The local game waits when the remote inputs are RB_WINDOW frames behind,
+// which bounds the frames played again after a single input to RB_WINDOW.
+
+#define RB_WINDOW 15  // frames the remote inputs may fall behind
+#define RB_FRAMES 32  // saved frames, a power of two over twice the window
+#define RB_NONE UINT32_MAX
+#define RB_HELD IN_SOFT_DROP
+
+typedef struct Rollback {
+    Versus vs;                          // state after the last frame played
+    Versus saved[RB_FRAMES];            // state before every frame, by frame number
+    u16 input[RB_FRAMES][VS_PLAYERS];   // inputs of every frame, the remote ones predicted until they arrive
+    u8 local;                           // player of this side
+    u32 frame;                          // frames played
+    u32 confirmed;                      // frames with the remote input received
+    u32 rewind;                         // first frame played with a wrong prediction, RB_NONE when none
+    u16 last;                           // last remote input received
+    u64 rollbacks;
+    u64 replayed;                       // frames played again
+} Rollback;
+
+void rb_init(Rollback *rb, u64 seed, u8 local);
+bool rb_ready(const Rollback *rb);
+void rb_advance(Rollback *rb, u16 input);
+bool rb_remote(Rollback *rb, u32 frame, u16 input);
+u32 rb_sync(Rollback *rb);
+bool rb_over(const Rollback *rb);
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "pacer.h"
+#include "pool.h"
+#include "server.h"
+
+// Headless game server: hosts many sessions in one process. The main thread
+// accepts the clients and hands every new session to the shard with the
+// fewest; a shard is a thread with its own epoll loop and frame timer that
+// reads the keys of its sessions and ticks all of them once per frame.
+
+#define DEFAULT_SESSIONS 100000
+#define REPORT_MS 1000
+#define ACCEPT_BACKOFF_MS 100 // out of files, the listener rests this long
+#define DRAIN_FRAMES FRAMERATE // most frames an ended session waits to send its last game state
+
+typedef struct Session {
+    Game game;
+    Paint paint;
+    int fd;
+    u32 slot;                 // index in the shard's sessions
+    u16 input;                // keys received since the last frame
+    bool closed;              // removed by the next frame
+    bool ended;               // the game ended, closed once its last state is sent
+    bool last_sent;           // that state was queued
+    u8 drain;                 // frames left to send it
+    u8 out_len;               // game state being sent
+    u8 out_pos;               // its bytes sent so far
+    u8 out[SRV_MSG_MAX];
+    struct Session *next;     // handed over to the shard, not taken yet
+} Session;
+
+typedef struct Shard {
+    pthread_t thread;
+    int epfd;
+    Pacer pacer;
+    Session **session;
+    u32 num;
+    u32 cap;
+    pthread_mutex_t lock;
+    Session *incoming;        // sessions handed over by the accepting thread
+    u32 live;                 // sessions handed over and not closed, atomic
+    u64 ticks;                // games ticked, atomic
+    u64 busy;                 // ns spent outside epoll_wait(), atomic
+    u64 dropped;              // game states not sent, atomic
+    u64 games;                // games ended by a top-out or a quit, atomic
+} Shard;
+
+static volatile sig_atomic_t stop_requested = 0;
+static bool stopping = false; // atomic, seen by the shards
+
+static void request_stop(int sig) {
+    (void) sig;
+    stop_requested = 1;
+}
+
+static void counter_add(u64 *counter, u64 n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static u64 counter_get(u64 *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Sends what is left of the game state being sent, closes the session on errors
+static void session_flush(Session *s) {
+    ssize_t n;
+
+    while (s->out_pos < s->out_len) {
+        n = send(s->fd, s->out + s->out_pos, s->out_len - s->out_pos, MSG_NOSIGNAL);
+        if (n > 0) {
+            s->out_pos += n;
+        } else if (n < 0 && errno == EAGAIN) {
+            return;
+        } else if (n == 0 || errno != EINTR) {
+            s->closed = true;
+            return;
+        }
+    }
+    s->out_len = s->out_pos = 0;
+}
+
+// Replaces the game state waiting to be sent, none of it may be sent yet
+static void session_pack(Session *s) {
+    s->out_len = 1 + snap_pack(&s->game, &s->paint, s->out + 1);
+    s->out[0] = s->out_len - 1;
+    session_flush(s);
+}
+
+// Sends the game state, unless a previous one is still partly sent
+static void session_send(Shard *shard, Session *s) {
+    if (s->out_pos > 0)
+        counter_add(&shard->dropped, 1);
+    else
+        session_pack(s);
+}
+
+// Reads the keys of a session until none are left
+static void session_read(Session *s) {
+    u8 buf[64];
+    ssize_t n;
+
+    for (;;) {
+        n = recv(s->fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            for (ssize_t i = 0; i < n; i++)
+                s->input |= buf[i];
+        } else if (n < 0 && errno == EAGAIN) {
+            return;
+        } else if (n == 0 || errno != EINTR) {
+            s->closed = true;
+            return;
+        }
+    }
+}
+
+static void session_close(Shard *shard, u32 slot) {
+    Session *s = shard->session[slot];
+
+    close(s->fd);
+    shard->session[slot] = shard->session[--shard->num];
+    shard->session[slot]->slot = slot;
+    free(s);
+    __atomic_fetch_sub(&shard->live, 1, __ATOMIC_RELAXED);
+}
+
+// Takes the sessions handed over since the last frame
+static void shard_take(Shard *shard) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET };
+    Session *s, *next, **grown;
+
+    pthread_mutex_lock(&shard->lock);
+    s = shard->incoming;
+    shard->incoming = NULL;
+    pthread_mutex_unlock(&shard->lock);
+
+    for (; s != NULL; s = next) {
+        next = s->next;
+        if (shard->num == shard->cap) {
+            grown = realloc(shard->session, (shard->cap * 2 + 64) * sizeof(Session *));
+            if (grown == NULL) { // no room, turn the client away
+                close(s->fd);
+                free(s);
+                __atomic_fetch_sub(&shard->live, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            shard->session = grown;
+            shard->cap = shard->cap * 2 + 64;
+        }
+
+        s->slot = shard->num;
+        shard->session[shard->num++] = s;
+        ev.data.ptr = s;
+        if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, s->fd, &ev) != 0)
+            s->closed = true;
+        else
+            session_send(shard, s);
+    }
+}
+
+// Plays a frame of every session; the sessions closed since the last
+// frame are removed first, the ended ones once their last game state was
+// sent whole, or it could not be for DRAIN_FRAMES
+static void shard_frame(Shard *shard) {
+    Session *s;
+    u32 ticked = 0;
+
+    shard_take(shard);
+    for (u32 i = 0; i < shard->num;) {
+        s = shard->session[i];
+        if (s->closed || (s->ended && ((s->last_sent && s->out_len == 0) || s->drain-- == 0))) {
+            session_close(shard, i);
+            continue;
+        }
+
+        if (!s->ended) {
+            if (!tick(&s->game, s->input)) {
+                s->ended = true;
+                s->drain = DRAIN_FRAMES;
+                counter_add(&shard->games, 1);
+            }
+            s->input = IN_NONE;
+            paint_update(&s->paint, &s->game);
+            if (s->game.tm_locked.type != BLACK && !s->ended)
+                session_send(shard, s);
+            ticked++;
+        }
+
+        // the last game state waits for the one before it to be sent whole
+        if (s->ended && !s->last_sent && s->out_pos == 0) {
+            session_pack(s);
+            s->last_sent = true;
+        }
+        i++;
+    }
+    counter_add(&shard->ticks, ticked);
+}
+
+static void *shard_main(void *arg) {
+    Shard *shard = arg;
+    struct epoll_event ev[SRV_EVENTS];
+    Session *s;
+    bool frame;
+    u64 start;
+    int n;
+
+    pacer_arm(&shard->pacer);
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        if ((n = epoll_wait(shard->epfd, ev, SRV_EVENTS, -1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // the reads and writes first, so the frame sees every key and
+        // removes sessions only after their last event
+        start = now_ns();
+        frame = false;
+        for (int i = 0; i < n; i++) {
+            if ((s = ev[i].data.ptr) == NULL) {
+                frame = true;
+                continue;
+            }
+            if (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                session_read(s);
+            if (ev[i].events & EPOLLOUT && !s->closed)
+                session_flush(s);
+        }
+        if (frame) {
+            pacer_fired(&shard->pacer);
+            shard_frame(shard);
+            pacer_arm(&shard->pacer);
+        }
+        counter_add(&shard->busy, now_ns() - start);
+    }
+
+    for (u32 i = 0; i < shard->num; i++) {
+        close(shard->session[i]->fd);
+        free(shard->session[i]);
+    }
+    shard->num = 0;
+    return NULL;
+}
+
+static bool shard_init(Shard *shard) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // the timer
+
+    *shard = (Shard) { 0 };
+    pthread_mutex_init(&shard->lock, NULL);
+    if (!pacer_init(&shard->pacer, FRAMERATE))
+        return false;
+    if ((shard->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return false;
+    return epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->pacer.fd, &ev) == 0;
+}
+
+// Hands a new session to the shard with the fewest
+static void shard_give(Shard *shard, u32 shards, Session *s) {
+    Shard *best = &shard[0];
+
+    for (u32 i = 1; i < shards; i++)
+        if (__atomic_load_n(&shard[i].live, __ATOMIC_RELAXED) < __atomic_load_n(&best->live, __ATOMIC_RELAXED))
+            best = &shard[i];
+
+    __atomic_fetch_add(&best->live, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&best->lock);
+    s->next = best->incoming;
+    best->incoming = s;
+    pthread_mutex_unlock(&best->lock);
+}
+
+// Raises the limit of open files to the hard one, a session takes a file
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, SRV_BACKLOG) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Prints the sessions, the games ticked per second and the CPU time they took
+// since the last report; sessions per core is how many sessions a fully busy
+// core would host at that cost
+static void report(Shard *shard, u32 shards, u64 *last_ticks, u64 *last_busy, u64 *last_time) {
+    u64 ticks = 0, busy = 0, sessions = 0, now = now_ns();
+    f64 elapsed = (now - *last_time) / 1.0e9, cores;
+
+    for (u32 i = 0; i < shards; i++) {
+        ticks += counter_get(&shard[i].ticks);
+        busy += counter_get(&shard[i].busy);
+        sessions += __atomic_load_n(&shard[i].live, __ATOMIC_RELAXED);
+    }
+
+    cores = (busy - *last_busy) / 1.0e9 / elapsed;
+    printf("sessions: %" PRIu64 " | ticks/s: %.0f | cores busy: %.3f | sessions/core: %.0f\n",
+           sessions, (ticks - *last_ticks) / elapsed, cores, cores > 0 ? sessions / cores : 0.0);
+    fflush(stdout);
+    *last_ticks = ticks;
+    *last_busy = busy;
+    *last_time = now;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-a socket_path] [-j shards] [-n max_sessions] [-s seed]\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *path = SRV_SOCKET;
+    u32 shards = cpu_count(), max_sessions = DEFAULT_SESSIONS, live;
+    u64 seed = 1, accepted = 0, games = 0, dropped = 0, late = 0;
+    u64 last_ticks = 0, last_busy = 0, last_time = now_ns(), resume = 0, now;
+    i64 timeout;
+    struct pollfd pfd;
+    Shard *shard;
+    Session *s;
+    int opt, fd, listen_fd;
+
+    while ((opt = getopt(argc, argv, "a:j:n:s:h")) != -1) {
+        switch (opt) {
+            case 'a': path = optarg; break;
+            case 'j': shards = strtoul(optarg, NULL, 10); break;
+            case 'n': max_sessions = strtoul(optarg, NULL, 10); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (shards == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    raise_fd_limit();
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((listen_fd = listen_on(path)) < 0) {
+        perror(path);
+        return 1;
+    }
+    pfd = (struct pollfd) { .fd = listen_fd, .events = POLLIN };
+
+    if ((shard = calloc(shards, sizeof(Shard))) == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    for (u32 i = 0; i < shards; i++) {
+        if (!shard_init(&shard[i]) || pthread_create(&shard[i].thread, NULL, shard_main, &shard[i]) != 0) {
+            perror("shard");
+            return 1;
+        }
+    }
+
+    while (!stop_requested) {
+        // until the next report, or the end of a rest of the listener
+        now = now_ns();
+        if (pfd.fd < 0 && now >= resume)
+            pfd.fd = listen_fd;
+        timeout = REPORT_MS - (i64) ((now - last_time) / 1000000);
+        if (pfd.fd < 0 && (i64) ((resume - now) / 1000000) + 1 < timeout)
+            timeout = (resume - now) / 1000000 + 1;
+        if (timeout < 0)
+            timeout = 0;
+
+        if (poll(&pfd, 1, timeout) > 0) {
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                live = 0;
+                for (u32 i = 0; i < shards; i++)
+                    live += __atomic_load_n(&shard[i].live, __ATOMIC_RELAXED);
+                if (live >= max_sessions || (s = malloc(sizeof(Session))) == NULL) {
+                    close(fd);
+                    continue;
+                }
+
+                *s = (Session) { .fd = fd };
+                game_init(&s->game, seed + accepted++);
+                paint_init(&s->paint);
+                shard_give(shard, shards, s);
+            }
+            // the pending client stays readable until a file is freed, stop polling it for a while
+            if (errno == EMFILE || errno == ENFILE) {
+                pfd.fd = -1;
+                resume = now_ns() + ACCEPT_BACKOFF_MS * 1000000ULL;
+            }
+        }
+        if (now_ns() - last_time >= REPORT_MS * 1000000ULL)
+            report(shard, shards, &last_ticks, &last_busy, &last_time);
+    }
+
+    __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+    for (u32 i = 0; i < shards; i++) {
+        pthread_join(shard[i].thread, NULL);
+        for (s = shard[i].incoming; s != NULL; s = shard[i].incoming) {
+            shard[i].incoming = s->next;
+            close(s->fd);
+            free(s);
+        }
+        games += shard[i].games;
+        dropped += shard[i].dropped;
+        late += shard[i].pacer.late + shard[i].pacer.skipped;
+        pacer_close(&shard[i].pacer);
+        close(shard[i].epfd);
+        free(shard[i].session);
+    }
+    close(listen_fd);
+    unlink(path);
+
+    printf("sessions:   %" PRIu64 " (%" PRIu64 " games ended)\n", accepted, games);
+    printf("shards:     %u\n", shards);
+    printf("dropped:    %" PRIu64 " game states\n", dropped);
+    printf("late:       %" PRIu64 " shard frames\n", late);
+    free(shard);
+    return 0;
+}
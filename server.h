@@ -0,0 +1,20 @@
+#pragma once
+
+#include "types.h"
+#include "snapshot.h"
+
+// Protocol of tetris-server, over a UNIX stream socket. Every connection is
+// a session playing its own game, paced by the server at FRAMERATE.
+//   client -> server: a byte per key, the Input bits; the bytes received
+//                     between two frames are applied together on the next one
+//   server -> client: u8 size, the game packed by snap_pack(), when the session
+//                     starts and after every frame locking a tetromino or ending
+//                     the game, which also ends the session
+// A game state that can't be sent whole right away is dropped, the next one
+// replaces it; the last one is always sent whole before the session ends,
+// unless the client reads none of it for FRAMERATE frames.
+
+#define SRV_SOCKET "/tmp/tetris.sock"  // default path of the socket
+#define SRV_MSG_MAX (1 + SNAP_MAX)
+#define SRV_BACKLOG 4096
+#define SRV_EVENTS 256  // epoll events taken at once
@@ -0,0 +1,310 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "pool.h"
+#include "bot.h"
+#include "replay.h"
+#include "rand.h"
+
+// Batch simulator: plays many independent games on all cores as fast as possible
+
+#define DEFAULT_GAMES 1000
+#define DEFAULT_FRAMES (FRAMERATE * 60 * 10)
+#define MAX_SCRIPT_LEN 65536
+
+typedef enum Policy {
+    POLICY_RANDOM, POLICY_SCRIPT, POLICY_REPLAY, POLICY_BOT
+} Policy;
+
+typedef struct Result {
+    u32 score;
+    u32 lines;
+    u32 frames;
+    u32 perfect;      // perfect clears
+    u8 level;
+    bool over;
+    bool mismatch;
+} Result;
+
+typedef struct Sim {
+    Policy policy;
+    u64 seed;
+    u32 max_frames;
+    u16 *script;
+    u32 script_len;
+    char **replays;
+    const char *record_dir;
+    u64 bot_budget_ns;
+    u8 bot_pc_pieces;   // perfect clear mode of the bot, 0 when off
+    Result *result;
+} Sim;
+
+// Returns an input chosen by the policy for a given frame
+static u16 sim_input(Sim *sim, u64 *rng, u32 frame) {
+    switch (sim->policy) {
+        case POLICY_SCRIPT:
+            return sim->script[frame % sim->script_len];
+        case POLICY_RANDOM:
+            return rand_input(rng);
+        case POLICY_REPLAY:
+        case POLICY_BOT:
+            break;
+    }
+
+    return IN_NONE;
+}
+
+// Plays a recorded game back and checks that it ends the same way
+static void sim_replay(Sim *sim, u32 task) {
+    Replay rp;
+    Game game;
+
+    if (!replay_open(&rp, sim->replays[task])) {
+        sim->result[task].mismatch = true;
+        return;
+    }
+
+    game_init(&game, rp.seed);
+    while (!replay_done(&rp))
+        tick(&game, replay_input(&rp));
+
+    sim->result[task] = (Result) {
+        .score = game.score,
+        .lines = game.lines_cleared,
+        .frames = rp.frame,
+        .level = game.level,
+        .over = game.over,
+        .mismatch = game.score != rp.end_score || game.lines_cleared != rp.end_lines,
+    };
+    replay_close(&rp);
+}
+
+// Plays a single game until top-out or the frame limit
+static void sim_game(void *ctx, u32 task, u32 worker) {
+    (void) worker;
+    Sim *sim = ctx;
+    Game game;
+    Recorder rec;
+    Bot bot;
+    char path[4096];
+    bool record = false;
+    u64 rng = sim->seed + task;
+    u32 frame = 0, lines, perfect = 0;
+    u16 input;
+
+    if (sim->policy == POLICY_REPLAY) {
+        sim_replay(sim, task);
+        return;
+    }
+
+    // the games already run in parallel, every bot searches on its own thread
+    if (sim->policy == POLICY_BOT && !bot_init(&bot, NULL, sim->bot_budget_ns))
+        return;
+    if (sim->policy == POLICY_BOT && sim->bot_pc_pieces > 0 && !bot_perfect_clears(&bot, sim->bot_pc_pieces)) {
+        bot_free(&bot);
+        return;
+    }
+
+    if (sim->record_dir != NULL) {
+        snprintf(path, sizeof(path), "%s/game-%" PRIu64 ".nctr", sim->record_dir, sim->seed + task);
+        record = rec_open(&rec, path, sim->seed + task, KEYFRAME_INTERVAL);
+    }
+
+    game_init(&game, sim->seed + task);
+    for (bool run = true; run && frame < sim->max_frames; frame++) {
+        input = sim->policy == POLICY_BOT ? bot_input(&bot, &game) : sim_input(sim, &rng, frame);
+        if (record)
+            rec_frame(&rec, &game, input);
+        lines = game.lines_cleared;
+        run = tick(&game, input);
+        if (game.lines_cleared != lines && game.board[FIELD_Y - 1] == 0)
+            perfect++;
+    }
+
+    if (record)
+        rec_close(&rec, &game);
+    if (sim->policy == POLICY_BOT)
+        bot_free(&bot);
+
+    sim->result[task] = (Result) {
+        .score = game.score,
+        .lines = game.lines_cleared,
+        .frames = frame,
+        .perfect = perfect,
+        .level = game.level,
+        .over = game.over,
+    };
+}
+
+// Translates a script token ("L", "CW+SD", "." ...) into an input
+static bool parse_token(char *token, u16 *input) {
+    static const struct { const char *name; u16 input; } names[] = {
+        { ".", IN_NONE }, { "L", IN_MV_LEFT }, { "R", IN_MV_RIGHT },
+        { "CW", IN_ROTATE_CW }, { "CCW", IN_ROTATE_CCW }, { "SD", IN_SOFT_DROP },
+        { "HD", IN_HARD_DROP }, { "H", IN_HOLD },
+    };
+    char *save, *name;
+    bool found;
+
+    *input = IN_NONE;
+    for (name = strtok_r(token, "+", &save); name != NULL; name = strtok_r(NULL, "+", &save)) {
+        found = false;
+        for (u8 i = 0; i < sizeof(names) / sizeof(names[0]) && !found; i++) {
+            if (strcmp(name, names[i].name) == 0) {
+                *input |= names[i].input;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+// Reads an input script; one whitespace separated token per frame
+static bool load_script(Sim *sim, const char *path) {
+    char token[64];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    sim->script = malloc(MAX_SCRIPT_LEN * sizeof(u16));
+    sim->script_len = 0;
+    while (sim->script_len < MAX_SCRIPT_LEN && fscanf(file, "%63s", token) == 1) {
+        if (!parse_token(token, &sim->script[sim->script_len])) {
+            fprintf(stderr, "%s: unknown input '%s'\n", path, token);
+            fclose(file);
+            free(sim->script);
+            sim->script = NULL;
+            return false;
+        }
+        sim->script_len++;
+    }
+    fclose(file);
+
+    if (sim->script_len == 0) {
+        fprintf(stderr, "%s: empty script\n", path);
+        free(sim->script);
+        sim->script = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-n games] [-j threads] [-s seed] [-f max_frames] [-p random|script|bot] [-i script] [-w dir] [-B budget_us] [-c pieces]\n"
+        "       %s [-j threads] -p replay replay...\n",
+        name, name);
+}
+
+int main(int argc, char **argv) {
+    Sim sim = {
+        .policy = POLICY_RANDOM,
+        .seed = 1,
+        .max_frames = DEFAULT_FRAMES,
+    };
+    u32 games = DEFAULT_GAMES;
+    u32 threads = cpu_count();
+    const char *script_path = NULL;
+    struct timespec start, end;
+    u64 frames = 0, score = 0, lines = 0, perfect = 0, over = 0, mismatched = 0;
+    u32 score_max = 0;
+    f64 elapsed;
+    Pool *pool;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:j:s:f:p:i:w:B:c:h")) != -1) {
+        switch (opt) {
+            case 'n': games = strtoul(optarg, NULL, 10); break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 's': sim.seed = strtoull(optarg, NULL, 10); break;
+            case 'f': sim.max_frames = strtoul(optarg, NULL, 10); break;
+            case 'i': script_path = optarg; sim.policy = POLICY_SCRIPT; break;
+            case 'w': sim.record_dir = optarg; break;
+            case 'B': sim.bot_budget_ns = strtoull(optarg, NULL, 10) * 1000; break;
+            case 'c': sim.bot_pc_pieces = strtoul(optarg, NULL, 10); break;
+            case 'p':
+                if (strcmp(optarg, "random") == 0) {
+                    sim.policy = POLICY_RANDOM;
+                } else if (strcmp(optarg, "script") == 0) {
+                    sim.policy = POLICY_SCRIPT;
+                } else if (strcmp(optarg, "replay") == 0) {
+                    sim.policy = POLICY_REPLAY;
+                } else if (strcmp(optarg, "bot") == 0) {
+                    sim.policy = POLICY_BOT;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (sim.policy == POLICY_SCRIPT && (script_path == NULL || !load_script(&sim, script_path))) {
+        if (script_path == NULL)
+            usage(argv[0]);
+        return 1;
+    }
+    if (sim.policy == POLICY_REPLAY) {
+        sim.replays = &argv[optind];
+        games = argc - optind;
+    }
+    if (games == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sim.result = calloc(games, sizeof(Result));
+    pool = pool_create(threads);
+    if (sim.result == NULL || pool == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pool_run(pool, games, sim_game, &sim);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9;
+
+    for (u32 i = 0; i < games; i++) {
+        frames += sim.result[i].frames;
+        score += sim.result[i].score;
+        lines += sim.result[i].lines;
+        perfect += sim.result[i].perfect;
+        over += sim.result[i].over;
+        if (sim.result[i].mismatch) {
+            fprintf(stderr, "%s: mismatch\n", sim.replays[i]);
+            mismatched++;
+        }
+        if (sim.result[i].score > score_max)
+            score_max = sim.result[i].score;
+    }
+
+    printf("games:      %u (%" PRIu64 " topped out)\n", games, over);
+    if (sim.policy == POLICY_REPLAY)
+        printf("mismatched: %" PRIu64 "\n", mismatched);
+    printf("threads:    %u\n", pool_workers(pool));
+    printf("score:      %.1f avg, %u max\n", (f64) score / games, score_max);
+    printf("lines:      %.2f avg\n", (f64) lines / games);
+    printf("perfect:    %" PRIu64 " clears\n", perfect);
+    printf("frames:     %" PRIu64 " (%.1f avg)\n", frames, (f64) frames / games);
+    printf("time:       %.3f s\n", elapsed);
+    printf("frames/s:   %.0f\n", frames / elapsed);
+    printf("games/s:    %.1f\n", games / elapsed);
+
+    pool_destroy(pool);
+    free(sim.result);
+    free(sim.script);
+    return mismatched == 0 ? 0 : 2;
+}
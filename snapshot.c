@@ -0,0 +1,200 @@
+#include <string.h>
+
+#include "snapshot.h"
+#include "tm_table.h"
+
+#define FLAG_ON_FLOOR      (1 << 0)
+#define FLAG_SWAPPED       (1 << 1)
+#define FLAG_GRAVITY_ACTED (1 << 2)
+#define FLAG_PAUSED        (1 << 3)
+#define FLAG_OVER          (1 << 4)
+
+#define COLOR_GARBAGE BLACK // packed color of a garbage cell, no taken cell is BLACK
+
+// Bits of the board and the colors follow each other from the lowest bit
+// of every byte, pos counts them
+static void put_bits(u8 *buf, size_t *pos, u32 val, u8 num) {
+    u8 shift, n;
+
+    while (num > 0) {
+        shift = *pos % 8;
+        n = 8 - shift < num ? 8 - shift : num;
+        if (shift == 0)
+            buf[*pos / 8] = 0;
+        buf[*pos / 8] |= (val & ((1 << n) - 1)) << shift;
+        val >>= n;
+        num -= n;
+        *pos += n;
+    }
+}
+
+static u32 get_bits(const u8 *buf, size_t *pos, u8 num) {
+    u32 val = 0;
+    u8 shift, n, got = 0;
+
+    while (got < num) {
+        shift = *pos % 8;
+        n = 8 - shift < num - got ? 8 - shift : num - got;
+        val |= (u32) ((buf[*pos / 8] >> shift) & ((1 << n) - 1)) << got;
+        got += n;
+        *pos += n;
+    }
+    return val;
+}
+
+// Writes an unsigned LEB128 number, returns its size
+static size_t put_var(u8 *buf, u32 val) {
+    size_t len = 0;
+
+    do {
+        buf[len++] = (val & 0x7f) | (val >> 7 != 0 ? 0x80 : 0);
+        val >>= 7;
+    } while (val != 0);
+    return len;
+}
+
+// Reads an unsigned LEB128 number, returns its size or 0 when it is broken
+static size_t get_var(const u8 *buf, size_t size, u32 *val) {
+    size_t len = 0;
+
+    *val = 0;
+    while (len < size && len < 5) {
+        *val |= (u32) (buf[len] & 0x7f) << (7 * len);
+        if (!(buf[len++] & 0x80))
+            return len;
+    }
+    return 0;
+}
+
+static size_t put_tm(u8 *buf, const Tetromino *tm) {
+    buf[0] = tm->type | tm->orientation << 4;
+    buf[1] = tm->pos.y + TM_SIZE;
+    buf[2] = tm->pos.x + TM_SIZE;
+    return 3;
+}
+
+// Reads a tetromino, false when its blocks would be out of the field
+static bool get_tm(const u8 *buf, Tetromino *tm) {
+    const BoundingBox *bbox;
+
+    *tm = (Tetromino) { buf[0] & 0xf, buf[0] >> 4, { buf[1] - TM_SIZE, buf[2] - TM_SIZE } };
+    if (tm->type > BLACK || tm->orientation >= TM_ORIENT)
+        return false;
+    if (tm->type == BLACK)
+        return true;
+
+    bbox = &TM_SHAPE[tm->type][tm->orientation].bbox;
+    return tm->pos.y + bbox->top >= 0 && tm->pos.y + bbox->bottom < FIELD_Y &&
+           tm->pos.x + bbox->left >= 0 && tm->pos.x + bbox->right < FIELD_X;
+}
+
+// Packs a game and the colors of its field, returns the packed size
+// (at most SNAP_MAX)
+size_t snap_pack(const Game *game, const Paint *paint, u8 *buf) {
+    size_t len = 0, bits = 0;
+    u8 color;
+
+    len += put_var(buf + len, game->score);
+    len += put_var(buf + len, game->lines_cleared);
+    buf[len++] = game->level;
+    buf[len++] = game->combo + 1;
+    for (u8 i = 0; i < 8; i++)
+        buf[len++] = game->rng >> (8 * i);
+    for (u8 i = 0; i < BAG_SIZE; i += 2)
+        buf[len++] = game->bag[i] | (i + 1 < BAG_SIZE ? game->bag[i + 1] << 4 : 0);
+    buf[len++] = game->bag_index;
+    len += put_tm(buf + len, &game->tm_field);
+    len += put_tm(buf + len, &game->tm_next);
+    len += put_tm(buf + len, &game->tm_hold);
+    buf[len++] = (game->on_floor ? FLAG_ON_FLOOR : 0) | (game->swapped ? FLAG_SWAPPED : 0) |
+                 (game->gravity_acted ? FLAG_GRAVITY_ACTED : 0) | (game->paused ? FLAG_PAUSED : 0) |
+                 (game->over ? FLAG_OVER : 0);
+    buf[len++] = game->gravity_timer;
+    buf[len++] = game->floor_timer;
+    buf[len++] = game->floor_counter;
+    buf[len++] = game->entry_delay;
+
+    for (u8 y = 0; y < FIELD_Y; y++)
+        put_bits(buf + len, &bits, game->board[y], FIELD_X);
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        for (u16 row = game->board[y]; row != 0; row &= row - 1) {
+            color = paint->color[y][__builtin_ctz(row)];
+            put_bits(buf + len, &bits, color == GRAY ? COLOR_GARBAGE : color, 3);
+        }
+    }
+
+    return len + (bits + 7) / 8;
+}
+
+// Restores a packed game and the colors of its field unless paint is NULL,
+// returns the size it took up or 0 when the data is broken
+size_t snap_unpack(Game *game, Paint *paint, const u8 *buf, size_t size) {
+    size_t len = 0, bits = 0, n, need;
+    u32 val;
+    u8 taken = 0, color;
+
+    if ((n = get_var(buf, size, &val)) == 0)
+        return 0;
+    game->score = val;
+    len += n;
+    if ((n = get_var(buf + len, size - len, &val)) == 0)
+        return 0;
+    game->lines_cleared = val;
+    len += n;
+
+    // the fixed part and the board rows, before the colors
+    need = 2 + 8 + (BAG_SIZE + 1) / 2 + 1 + 3 * 3 + 1 + 4;
+    if (size - len < need + (FIELD_Y * FIELD_X + 7) / 8)
+        return 0;
+
+    if ((game->level = buf[len++]) == 0)
+        return 0;
+    game->combo = buf[len++] - 1;
+    game->rng = 0;
+    for (u8 i = 0; i < 8; i++)
+        game->rng |= (u64) buf[len++] << (8 * i);
+    for (u8 i = 0; i < BAG_SIZE; i++)
+        if ((game->bag[i] = (buf[len + i / 2] >> (i % 2 * 4)) & 0xf) >= TM_NUM)
+            return 0;
+    len += (BAG_SIZE + 1) / 2;
+    if ((game->bag_index = buf[len++]) >= BAG_SIZE)
+        return 0;
+    if (!get_tm(buf + len, &game->tm_field) || !get_tm(buf + len + 3, &game->tm_next) ||
+        !get_tm(buf + len + 6, &game->tm_hold))
+        return 0;
+    len += 9;
+    game->on_floor = buf[len] & FLAG_ON_FLOOR;
+    game->swapped = buf[len] & FLAG_SWAPPED;
+    game->gravity_acted = buf[len] & FLAG_GRAVITY_ACTED;
+    game->paused = buf[len] & FLAG_PAUSED;
+    game->over = buf[len++] & FLAG_OVER;
+    game->gravity_timer = buf[len++];
+    game->floor_timer = buf[len++];
+    game->floor_counter = buf[len++];
+    game->entry_delay = buf[len++];
+    // the next tetromino is always dealt, the field one only out of the entry delay
+    if (game->tm_next.type == BLACK || (game->tm_field.type == BLACK) != (game->entry_delay > 0))
+        return 0;
+
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        game->board[y] = get_bits(buf + len, &bits, FIELD_X);
+        taken += __builtin_popcount(game->board[y]);
+    }
+    if (size - len < (bits + 3 * taken + 7) / 8)
+        return 0;
+    if (paint != NULL)
+        paint_init(paint);
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        for (u16 row = game->board[y]; row != 0; row &= row - 1) {
+            if ((color = get_bits(buf + len, &bits, 3)) == COLOR_GARBAGE)
+                color = GRAY;
+            if (paint != NULL)
+                paint->color[y][__builtin_ctz(row)] = color;
+        }
+    }
+
+    game->tm_locked = (Tetromino) { .type = BLACK };
+    game->cleared = 0;
+    update_columns(game);
+    return len + (bits + 7) / 8;
+}
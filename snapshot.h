@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include "game.h"
+
+// Game holds no pointers, so copying it (and its Paint, when drawn) is
+// a complete checkpoint of a game and copying it back restores it. The packed
+// form is the one for files: it doesn't depend on the layout of Game or the
+// build, leaves out what can be derived (the column masks and the hash) and
+// stores the board as bits, with the colors of the taken cells only.
+//   var score, var lines cleared, u8 level, u8 combo + 1, u64 rng,
+//   bag (4 bits per type), u8 bag index, 3 x tetromino (u8 type |
+//   orientation << 4, u8 y + TM_SIZE, u8 x + TM_SIZE), u8 flags,
+//   u8 gravity timer, u8 floor timer, u8 floor counter, u8 entry delay,
+//   board rows (FIELD_X bits each), colors of the taken cells (3 bits each,
+//   BLACK standing for the GRAY of garbage)
+
+#define SNAP_MAX 160  // largest packed size
+
+size_t snap_pack(const Game *game, const Paint *paint, u8 *buf);
+size_t snap_unpack(Game *game, Paint *paint, const u8 *buf, size_t size);
@@ -0,0 +1,93 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats.h"
+
+// Current time of the monotonic clock
+u64 now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Bytes written by the process so far, 0 if unknown
+u64 bytes_written() {
+    static int fd = -2;
+    char buf[512], *wchar;
+    ssize_t len;
+
+    if (fd == -2)
+        fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || (len = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    wchar = strstr(buf, "wchar:");
+    return wchar != NULL ? strtoull(wchar + 6, NULL, 10) : 0;
+}
+
+void hist_init(Hist *hist, u64 bucket_ns) {
+    *hist = (Hist) { .bucket_ns = bucket_ns > 0 ? bucket_ns : 1 };
+}
+
+void hist_add(Hist *hist, u64 ns) {
+    u64 bucket = ns / hist->bucket_ns;
+    hist->count[bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1]++;
+    hist->n++;
+    hist->sum += ns;
+    if (ns > hist->max)
+        hist->max = ns;
+}
+
+// Upper edge of the bucket holding the p-th fraction (0 to 1) of the samples
+u64 hist_percentile(Hist *hist, f64 p) {
+    u64 rank = (u64) (p * hist->n), seen = 0;
+
+    for (u16 i = 0; i < HIST_BUCKETS - 1; i++) {
+        seen += hist->count[i];
+        if (seen > rank)
+            return (i + 1) * hist->bucket_ns < hist->max ? (i + 1) * hist->bucket_ns : hist->max;
+    }
+    return hist->max;
+}
+
+// Prints a summary line followed by the non-empty buckets, in microseconds
+void hist_dump(Hist *hist, FILE *file, const char *name) {
+    fprintf(file, "%s: n %" PRIu64 " avg %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f us\n", name,
+            hist->n, hist->n > 0 ? hist->sum / 1.0e3 / hist->n : 0.0,
+            hist_percentile(hist, 0.5) / 1.0e3, hist_percentile(hist, 0.9) / 1.0e3,
+            hist_percentile(hist, 0.99) / 1.0e3, hist->max / 1.0e3);
+
+    for (u16 i = 0; i < HIST_BUCKETS; i++) {
+        if (hist->count[i] == 0)
+            continue;
+        fprintf(file, "  %8.1f%s %u\n", i * hist->bucket_ns / 1.0e3,
+                i == HIST_BUCKETS - 1 ? "+" : " ", hist->count[i]);
+    }
+}
+
+void roll_add(Rolling *roll, u64 val) {
+    if (roll->num == ROLL_SIZE)
+        roll->sum -= roll->sample[roll->next];
+    else
+        roll->num++;
+
+    roll->sample[roll->next] = val;
+    roll->sum += val;
+    roll->next = (roll->next + 1) % ROLL_SIZE;
+}
+
+f64 roll_avg(Rolling *roll) {
+    return roll->num > 0 ? (f64) roll->sum / roll->num : 0.0;
+}
+
+u64 roll_max(Rolling *roll) {
+    u64 max = 0;
+    for (u8 i = 0; i < roll->num; i++)
+        if (roll->sample[i] > max)
+            max = roll->sample[i];
+    return max;
+}
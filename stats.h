@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdio.h>
+#include "types.h"
+
+#define HIST_BUCKETS 256
+#define ROLL_SIZE 64
+
+// Histogram of durations in fixed-width buckets; the last bucket also
+// counts everything longer than it
+typedef struct Hist {
+    u64 bucket_ns;
+    u32 count[HIST_BUCKETS];
+    u64 n;
+    u64 sum;
+    u64 max;
+} Hist;
+
+// The last ROLL_SIZE samples of a value
+typedef struct Rolling {
+    u64 sample[ROLL_SIZE];
+    u64 sum;
+    u8 next;
+    u8 num;
+} Rolling;
+
+u64 now_ns();
+u64 bytes_written();
+void hist_init(Hist *hist, u64 bucket_ns);
+void hist_add(Hist *hist, u64 ns);
+u64 hist_percentile(Hist *hist, f64 p);
+void hist_dump(Hist *hist, FILE *file, const char *name);
+void roll_add(Rolling *roll, u64 val);
+f64 roll_avg(Rolling *roll);
+u64 roll_max(Rolling *roll);
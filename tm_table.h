@@ -0,0 +1,45 @@
+#pragma once
+
+#include "game.h"
+
+// Tables generated by tmgen into tm_table.c
+
+// Column offsets a tetromino origin can take: from -(TM_SIZE - 1) to FIELD_X - 1
+#define TM_COLS (FIELD_X + TM_SIZE - 1)
+#define TM_COL(x) ((x) + TM_SIZE - 1)
+
+// Block sizes (in characters) of the Next and Hold previews
+#define BLOCK_SIZE_NUM 2
+#define BLOCK_SIZES { { 1, 2 }, { 2, 4 } }
+
+#define TM_NO_BLOCK 0xff
+
+// Columns covered by one half row table of the Zobrist keys
+#define ZOBRIST_HALF (FIELD_X / 2)
+
+typedef struct TmShape {
+    Vec block[TM_SIZE];
+    BoundingBox bbox;
+    i16 spawn_x;
+    u8 floor[TM_SIZE]; // lowest block row of every column, TM_NO_BLOCK if it has none
+} TmShape;
+
+// Blocks, bounding box, centered spawn column and column floors of every orientation
+extern const TmShape TM_SHAPE[TM_NUM][TM_ORIENT];
+
+// Field row masks of every orientation for every origin column,
+// indexed by rows relative to the tetromino origin
+extern const u16 TM_MASK[TM_NUM][TM_ORIENT][TM_COLS][TM_SIZE];
+
+// Origins for drawing tetrominoes in Hold and Next windows
+extern const Vec TM_NH_POS[BLOCK_SIZE_NUM][TM_NUM][TM_ORIENT];
+
+// Zobrist keys of the board cells, of the field and held tetromino types
+// (BLACK for none) and of the bag position
+extern const u64 ZOBRIST_CELL[FIELD_Y][FIELD_X];
+extern const u64 ZOBRIST_PIECE[TM_NUM + 1];
+extern const u64 ZOBRIST_HOLD[TM_NUM + 1];
+extern const u64 ZOBRIST_BAG[BAG_SIZE];
+
+// Keys of every half row occupancy, the XOR of the keys of its cells
+extern const u64 ZOBRIST_ROW[FIELD_Y][2][1 << ZOBRIST_HALF];
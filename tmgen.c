@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include "game.h"
+#include "tm_table.h"
+
+// Generates the tetromino geometry tables (tm_table.c) to stdout
+
+// All tetromino variants saved as arrays of blocks
+static const Vec TM_BLOCKS[TM_NUM][TM_ORIENT][TM_SIZE] = { // relative (y, x) coordinates
+    { // O
+        { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
+        { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
+        { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
+        { {0, 0}, {0, 1}, {1, 0}, {1, 1} }
+    },
+    { // Z
+        { {1, 2}, {1, 1}, {0, 1}, {0, 0} },
+        { {2, 1}, {1, 1}, {1, 2}, {0, 2} },
+        { {1, 0}, {1, 1}, {2, 1}, {2, 2} },
+        { {0, 1}, {1, 1}, {1, 0}, {2, 0} }
+    },
+    { // S
+        { {1, 0}, {1, 1}, {0, 1}, {0, 2} },
+        { {0, 1}, {1, 1}, {1, 2}, {2, 2} },
+        { {1, 2}, {1, 1}, {2, 1}, {2, 0} },
+        { {2, 1}, {1, 1}, {1, 0}, {0, 0} }
+    },
+    { // L
+        { {1, 0}, {1, 1}, {1, 2}, {0, 2} },
+        { {0, 1}, {1, 1}, {2, 1}, {2, 2} },
+        { {1, 0}, {1, 1}, {1, 2}, {2, 0} },
+        { {0, 1}, {1, 1}, {2, 1}, {0, 0} },
+    },
+    { // J
+        { {1, 0}, {1, 1}, {1, 2}, {0, 0} },
+        { {0, 1}, {1, 1}, {2, 1}, {0, 2} },
+        { {1, 0}, {1, 1}, {1, 2}, {2, 2} },
+        { {0, 1}, {1, 1}, {2, 1}, {2, 0} },
+    },
+    { // T
+        { {1, 0}, {1, 1}, {1, 2}, {0, 1} },
+        { {0, 1}, {1, 1}, {2, 1}, {1, 2} },
+        { {1, 0}, {1, 1}, {1, 2}, {2, 1} },
+        { {0, 1}, {1, 1}, {2, 1}, {1, 0} },
+    },
+    { // I
+        { {1, 0}, {1, 1}, {1, 2}, {1, 3} },
+        { {0, 2}, {1, 2}, {2, 2}, {3, 2} },
+        { {2, 0}, {2, 1}, {2, 2}, {2, 3} },
+        { {0, 1}, {1, 1}, {2, 1}, {3, 1} },
+    },
+};
+
+static const Vec BLOCK_SIZE[BLOCK_SIZE_NUM] = BLOCK_SIZES;
+
+// Seed of the Zobrist keys, changing it invalidates stored hashes
+#define ZOBRIST_SEED 0x6e637465747269ULL
+
+// Calculates the bounding box for tetrominoes
+static BoundingBox calc_bbox(const Vec block[TM_SIZE]) {
+    BoundingBox bbox =  {
+        .top = TM_SIZE - 1,
+        .left = TM_SIZE - 1,
+        .right = 0,
+        .bottom = 0
+    };
+
+    for (u8 i = 0; i < TM_SIZE; i++) {
+        if (block[i].x < bbox.left)
+            bbox.left = block[i].x;
+        if (block[i].x > bbox.right)
+            bbox.right = block[i].x;
+        if (block[i].y < bbox.top)
+            bbox.top = block[i].y;
+        if (block[i].y > bbox.bottom)
+            bbox.bottom = block[i].y;
+    }
+
+    return bbox;
+}
+
+// Calculates the correct origin for drawing tetrominos in Hold and Next windows
+static Vec calc_nh_pos(Vec block_size, BoundingBox bbox) {
+    Vec nh_pos = { BORDER_THICKNESS, BORDER_THICKNESS };
+    u8 margin_h, margin_v;
+
+    // Calculating the margin size in drawing coordinates
+    margin_h = (TM_SIZE - (bbox.right - bbox.left + 1)) * block_size.x / 2;
+    margin_v = (TM_SIZE - (bbox.bottom - bbox.top + 1)) * block_size.y / 2;
+
+    nh_pos.x += margin_h - bbox.left * block_size.x;
+    nh_pos.y += margin_v - bbox.top * block_size.y;
+
+    return nh_pos;
+}
+
+// Column which centers a tetromino on the field
+static i16 calc_spawn_x(BoundingBox bbox) {
+    return (FIELD_X - (bbox.right - bbox.left + 1)) / 2 - bbox.left;
+}
+
+// Lowest block row of a tetromino column
+static u8 calc_floor(const Vec block[TM_SIZE], u8 col) {
+    u8 floor = TM_NO_BLOCK;
+    for (u8 i = 0; i < TM_SIZE; i++)
+        if (block[i].x == col && (floor == TM_NO_BLOCK || block[i].y > floor))
+            floor = block[i].y;
+    return floor;
+}
+
+// Field row mask of a tetromino row placed with its origin in column x,
+// blocks outside of the field are left out
+static u16 calc_mask(const Vec block[TM_SIZE], u8 row, i16 x) {
+    u16 mask = 0;
+    for (u8 i = 0; i < TM_SIZE; i++)
+        if (block[i].y == row && x + block[i].x >= 0 && x + block[i].x < FIELD_X)
+            mask |= 1 << (x + block[i].x);
+    return mask;
+}
+
+static void print_shapes() {
+    BoundingBox bbox;
+
+    printf("const TmShape TM_SHAPE[TM_NUM][TM_ORIENT] = {\n");
+    for (u8 t = 0; t < TM_NUM; t++) {
+        printf("    {\n");
+        for (u8 o = 0; o < TM_ORIENT; o++) {
+            bbox = calc_bbox(TM_BLOCKS[t][o]);
+            printf("        { { ");
+            for (u8 i = 0; i < TM_SIZE; i++)
+                printf("{%d, %d}%s", TM_BLOCKS[t][o][i].y, TM_BLOCKS[t][o][i].x, i < TM_SIZE - 1 ? ", " : "");
+            printf(" }, { %u, %u, %u, %u }, %d, { ",
+                   bbox.top, bbox.bottom, bbox.left, bbox.right, calc_spawn_x(bbox));
+            for (u8 c = 0; c < TM_SIZE; c++)
+                printf("0x%02x%s", calc_floor(TM_BLOCKS[t][o], c), c < TM_SIZE - 1 ? ", " : "");
+            printf(" } },\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n\n");
+}
+
+static void print_masks() {
+    printf("const u16 TM_MASK[TM_NUM][TM_ORIENT][TM_COLS][TM_SIZE] = {\n");
+    for (u8 t = 0; t < TM_NUM; t++) {
+        printf("    {\n");
+        for (u8 o = 0; o < TM_ORIENT; o++) {
+            printf("        {\n");
+            for (i16 x = -(TM_SIZE - 1); x < FIELD_X; x++) {
+                printf("            { ");
+                for (u8 y = 0; y < TM_SIZE; y++)
+                    printf("0x%03x%s", calc_mask(TM_BLOCKS[t][o], y, x), y < TM_SIZE - 1 ? ", " : "");
+                printf(" }, // %d\n", x);
+            }
+            printf("        },\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n\n");
+}
+
+static void print_nh_pos() {
+    Vec nh_pos;
+
+    printf("const Vec TM_NH_POS[BLOCK_SIZE_NUM][TM_NUM][TM_ORIENT] = {\n");
+    for (u8 s = 0; s < BLOCK_SIZE_NUM; s++) {
+        printf("    {\n");
+        for (u8 t = 0; t < TM_NUM; t++) {
+            printf("        { ");
+            for (u8 o = 0; o < TM_ORIENT; o++) {
+                nh_pos = calc_nh_pos(BLOCK_SIZE[s], calc_bbox(TM_BLOCKS[t][o]));
+                printf("{%d, %d}%s", nh_pos.y, nh_pos.x, o < TM_ORIENT - 1 ? ", " : "");
+            }
+            printf(" },\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n");
+}
+
+// splitmix64, generates the Zobrist keys
+static u64 zobrist_next(u64 *state) {
+    u64 z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Prints an array of keys in braces, four of them per line
+static void print_keys(const u64 *key, u32 num, const char *indent) {
+    printf("{\n");
+    for (u32 i = 0; i < num; i++)
+        printf("%s%s0x%016llxULL,%s", i % 4 == 0 ? indent : "", i % 4 == 0 ? "    " : " ",
+               (unsigned long long) key[i], i % 4 == 3 || i == num - 1 ? "\n" : "");
+    printf("%s}", indent);
+}
+
+static void print_zobrist() {
+    u64 state = ZOBRIST_SEED, cell[FIELD_Y][FIELD_X], piece[TM_NUM + 1], hold[TM_NUM + 1], bag[BAG_SIZE];
+    u64 row[FIELD_Y][2][1 << ZOBRIST_HALF];
+
+    for (u8 y = 0; y < FIELD_Y; y++)
+        for (u8 x = 0; x < FIELD_X; x++)
+            cell[y][x] = zobrist_next(&state);
+    for (u8 t = 0; t <= TM_NUM; t++)
+        piece[t] = zobrist_next(&state);
+    for (u8 t = 0; t <= TM_NUM; t++)
+        hold[t] = zobrist_next(&state);
+    for (u8 i = 0; i < BAG_SIZE; i++)
+        bag[i] = zobrist_next(&state);
+
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        for (u8 h = 0; h < 2; h++) {
+            for (u16 bits = 0; bits < 1 << ZOBRIST_HALF; bits++) {
+                row[y][h][bits] = 0;
+                for (u8 x = 0; x < ZOBRIST_HALF; x++)
+                    if (bits & (1 << x))
+                        row[y][h][bits] ^= cell[y][h * ZOBRIST_HALF + x];
+            }
+        }
+    }
+
+    printf("const u64 ZOBRIST_CELL[FIELD_Y][FIELD_X] = {\n");
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        printf("    ");
+        print_keys(cell[y], FIELD_X, "    ");
+        printf(",\n");
+    }
+    printf("};\n\nconst u64 ZOBRIST_PIECE[TM_NUM + 1] = ");
+    print_keys(piece, TM_NUM + 1, "");
+    printf(";\n\nconst u64 ZOBRIST_HOLD[TM_NUM + 1] = ");
+    print_keys(hold, TM_NUM + 1, "");
+    printf(";\n\nconst u64 ZOBRIST_BAG[BAG_SIZE] = ");
+    print_keys(bag, BAG_SIZE, "");
+    printf(";\n\nconst u64 ZOBRIST_ROW[FIELD_Y][2][1 << ZOBRIST_HALF] = {\n");
+    for (u8 y = 0; y < FIELD_Y; y++) {
+        printf("    {\n");
+        for (u8 h = 0; h < 2; h++) {
+            printf("        ");
+            print_keys(row[y][h], 1 << ZOBRIST_HALF, "        ");
+            printf(",\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n");
+}
+
+int main() {
+    printf("// Generated by tmgen, do not edit\n\n");
+    printf("#include \"tm_table.h\"\n\n");
+    print_shapes();
+    print_masks();
+    print_nh_pos();
+    printf("\n");
+    print_zobrist();
+    return 0;
+}
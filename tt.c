@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tt.h"
+
+// Allocates an empty table of 2^bits slots
+bool tt_init(Tt *tt, u8 bits) {
+    tt->mask = (1ull << bits) - 1;
+    tt->slot = calloc(tt->mask + 1, sizeof(TtSlot));
+    return tt->slot != NULL;
+}
+
+void tt_free(Tt *tt) {
+    free(tt->slot);
+    tt->slot = NULL;
+}
+
+// Empties the table, not safe while other threads use it
+void tt_clear(Tt *tt) {
+    memset(tt->slot, 0, (tt->mask + 1) * sizeof(TtSlot));
+}
+
+// Looks a key up, writing its value to data when found
+bool tt_probe(Tt *tt, u64 key, u64 *data) {
+    TtSlot *slot = &tt->slot[key & tt->mask];
+    u64 check = __atomic_load_n(&slot->check, __ATOMIC_RELAXED);
+    u64 value = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+
+    if ((check ^ value) != key)
+        return false;
+    *data = value;
+    return true;
+}
+
+// Stores the value of a key over whatever its slot held
+void tt_store(Tt *tt, u64 key, u64 data) {
+    TtSlot *slot = &tt->slot[key & tt->mask];
+
+    __atomic_store_n(&slot->check, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->data, data, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include "types.h"
+
+// Transposition table: a fixed number of slots indexed by the low bits of a
+// 64-bit key (a Zobrist hash), every slot holding one 64-bit value. Threads
+// share it without locks: a slot stores the key XORed with the value, so a
+// slot torn by concurrent writers fails the key check instead of returning
+// a wrong value. A store always replaces the slot. Empty slots hold the key 0.
+
+typedef struct TtSlot {
+    u64 check;  // key ^ data
+    u64 data;
+} TtSlot;
+
+typedef struct Tt {
+    TtSlot *slot;
+    u64 mask;   // number of slots - 1
+} Tt;
+
+bool tt_init(Tt *tt, u8 bits);
+void tt_free(Tt *tt);
+void tt_clear(Tt *tt);
+bool tt_probe(Tt *tt, u64 key, u64 *data);
+void tt_store(Tt *tt, u64 key, u64 data);
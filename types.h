@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// basic variables
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t i8;
+typedef int16_t i16;
+typedef int32_t i32;
+typedef int64_t i64;
+typedef float f32;
+typedef double f64;
+
+typedef enum {
+    WHITE, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, BLACK, GRAY
+} Color;
@@ -1,6 +1,5 @@
 #include <curses.h>
 #include <locale.h>
-#include <time.h>
 #include "utils.h"
 #include "game.h"
 
@@ -8,6 +7,11 @@
 void init_ncurses() {
     setlocale(LC_ALL, "");
     initscr();
+    setup_screen();
+}
+
+// sets up input modes and colors of the current screen
+void setup_screen() {
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
@@ -31,7 +35,6 @@ void border_draw(WINDOW *win, char *title) {
     box(win, 0, 0);
     if (title[0] != '\0') // draw title if not empty
         mvwprintw(win, 0, 1, "|%s|", title);
-    wnoutrefresh(win);
 }
 
 // gets the dimensions of stdscr
@@ -39,25 +42,17 @@ inline Windim get_scrdim() {
     return (Windim) { (u16) getmaxy(stdscr), (u16) getmaxx(stdscr) };
 }
 
-// translates a float containing seconds into a timespec representation
-struct timespec ns_to_timespec(f64 time) {
-    struct timespec time_ts;
-    time_ts.tv_sec = (u64) time;
-    time_ts.tv_nsec = (__time_t) ((time - time_ts.tv_sec) * 1.0e9);
-    return time_ts;
-}
-
-// Calculates the time needed to sleep to achieve constant framerate
-struct timespec time_to_sleep(struct timespec time) {
-    struct timespec time_now, sleep_ts, frametime;
-    clock_gettime(CLOCK_REALTIME, &time_now);
-    frametime = ns_to_timespec(FRAMETIME);
-    sleep_ts.tv_sec  = frametime.tv_sec  - (time_now.tv_sec  - time.tv_sec);
-    sleep_ts.tv_nsec = frametime.tv_nsec - (time_now.tv_nsec - time.tv_nsec);
-    if (sleep_ts.tv_nsec <= 0) {
-        sleep_ts.tv_sec--;
-        sleep_ts.tv_nsec += 1000000000;
+// translates a pressed key into game input
+u16 key_input(i16 ch) {
+    switch (ch) {
+        case CH_MV_LEFT:    return IN_MV_LEFT;
+        case CH_MV_RIGHT:   return IN_MV_RIGHT;
+        case CH_ROTATE_CW:  return IN_ROTATE_CW;
+        case CH_ROTATE_CCW: return IN_ROTATE_CCW;
+        case CH_SOFT_DROP:  return IN_SOFT_DROP;
+        case CH_HARD_DROP:  return IN_HARD_DROP;
+        case CH_HOLD:       return IN_HOLD;
+        case CH_QUIT:       return IN_QUIT;
     }
-
-    return sleep_ts;
+    return IN_NONE;
 }
@@ -0,0 +1,76 @@
+#include "versus.h"
+
+#define VS_RNG_MULT 6364136223846793005ULL
+#define VS_RNG_INC 1442695040888963407ULL
+
+// Garbage lines sent by a lock, by the number of lines it cleared
+static const u8 ATTACK[TM_SIZE + 1] = { 0, 0, 1, 2, 4 };
+
+void versus_init(Versus *vs, u64 seed) {
+    *vs = (Versus) { .rng = seed ^ VS_RNG_INC };
+    for (u8 p = 0; p < VS_PLAYERS; p++) {
+        game_init(&vs->game[p], seed);
+        paint_init(&vs->paint[p]);
+    }
+}
+
+// Picks the hole column of an attack
+static u8 hole_column(Versus *vs) {
+    vs->rng = vs->rng * VS_RNG_MULT + VS_RNG_INC;
+    return ((vs->rng >> 32) * FIELD_X) >> 32;
+}
+
+// Garbage lines sent by the last tick of a game
+static u8 attack(const Game *game) {
+    u8 lines = __builtin_popcount(game->cleared);
+
+    if (lines == 0)
+        return 0;
+    if (game->board[FIELD_Y - 1] == 0) // perfect clear
+        return VS_PERFECT_CLEAR;
+    return ATTACK[lines];
+}
+
+// Plays a frame of both games, returns false once one of them was lost
+bool versus_tick(Versus *vs, const u16 input[VS_PLAYERS]) {
+    u8 sent[VS_PLAYERS], cancel, hole;
+    Game *game;
+
+    if (vs->lost != 0)
+        return false;
+
+    for (u8 p = 0; p < VS_PLAYERS; p++) {
+        if (!tick(&vs->game[p], input[p]))
+            vs->lost |= 1 << p;
+        paint_update(&vs->paint[p], &vs->game[p]);
+        sent[p] = attack(&vs->game[p]);
+    }
+
+    // both players cancel their own garbage before sending, so the order doesn't matter
+    for (u8 p = 0; p < VS_PLAYERS; p++) {
+        cancel = sent[p] < vs->pending[p] ? sent[p] : vs->pending[p];
+        sent[p] -= cancel;
+        vs->pending[p] -= cancel;
+        vs->sent[p] += sent[p];
+    }
+    for (u8 p = 0; p < VS_PLAYERS; p++) {
+        u8 *pending = &vs->pending[VS_PLAYERS - 1 - p];
+        *pending = *pending + sent[p] < FIELD_Y ? *pending + sent[p] : FIELD_Y;
+    }
+
+    for (u8 p = 0; p < VS_PLAYERS; p++) {
+        game = &vs->game[p];
+        if (game->tm_locked.type == BLACK || game->cleared != 0 || vs->pending[p] == 0 || game->over)
+            continue;
+        hole = hole_column(vs);
+        if (!add_garbage(game, vs->pending[p], hole)) {
+            game->over = true;
+            vs->lost |= 1 << p;
+        }
+        paint_garbage(&vs->paint[p], vs->pending[p], hole);
+        vs->pending[p] = 0;
+    }
+
+    vs->frame++;
+    return vs->lost == 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include "game.h"
+
+// Two games played against each other. Both deal the same tetrominoes, and
+// a lock that clears lines sends garbage to the opponent: 1 line for a double,
+// 2 for a triple, 4 for a tetris and VS_PERFECT_CLEAR for a perfect clear,
+// less the garbage waiting for the sender, which it cancels first. Waiting
+// garbage rises when its player locks a tetromino without clearing a line,
+// as rows taken but for a hole column, the same for all the rows rising together.
+// A player loses by topping out or quitting. Everything here follows from
+// the seed and the inputs, so both sides of a network game compute the same
+// frames, and a Versus holds no pointers, so copying it is a checkpoint.
+
+#define VS_PLAYERS 2
+#define VS_PERFECT_CLEAR 10
+
+typedef struct Versus {
+    Game game[VS_PLAYERS];
+    Paint paint[VS_PLAYERS];
+    u8 pending[VS_PLAYERS]; // garbage lines waiting to rise, at most FIELD_Y
+    u32 sent[VS_PLAYERS];   // garbage lines sent in total
+    u64 rng;                // hole columns of the garbage
+    u32 frame;              // frames played, up to the one that ended the game
+    u8 lost;                // bit p is set when player p lost
+} Versus;
+
+void versus_init(Versus *vs, u64 seed);
+bool versus_tick(Versus *vs, const u16 input[VS_PLAYERS]);